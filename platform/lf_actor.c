@@ -0,0 +1,389 @@
+#include "lf_actor.h"
+
+#ifndef LF_HOST_STAND_IN
+#include <xcore/assert.h>
+#endif
+
+// Message layout: kind and input, time (high and low word), microstep, value.
+#define MESSAGE_WORDS 5
+#define MESSAGE_DATA 1
+#define MESSAGE_PROMISE 2
+
+#define FOREVER_TAG ((lf_actor_tag_t) { LF_ACTOR_FOREVER, UINT32_MAX })
+
+static instant_t _lf_actor_start_time;
+static instant_t _lf_actor_stop_time;
+static bool _lf_actor_fast;
+
+static int _lf_actor_tag_compare(lf_actor_tag_t a, lf_actor_tag_t b) {
+    if (a.time != b.time) {
+        return a.time < b.time ? -1 : 1;
+    }
+    if (a.microstep != b.microstep) {
+        return a.microstep < b.microstep ? -1 : 1;
+    }
+    return 0;
+}
+
+static lf_actor_tag_t _lf_actor_tag_min(lf_actor_tag_t a, lf_actor_tag_t b) {
+    return _lf_actor_tag_compare(a, b) <= 0 ? a : b;
+}
+
+static lf_actor_tag_t _lf_actor_tag_delay(lf_actor_tag_t tag, interval_t delay) {
+    if (tag.time == LF_ACTOR_FOREVER) {
+        return tag;
+    }
+    if (delay == 0) {
+        return (lf_actor_tag_t) { tag.time, tag.microstep + 1 };
+    }
+    return (lf_actor_tag_t) { tag.time + delay, 0 };
+}
+
+int lf_actor_init(lf_actor_t* actor, const char* name, lf_actor_react_t react, void* state,
+        size_t number_of_inputs) {
+    xassert(actor && number_of_inputs <= LF_ACTOR_MAX_PORTS);
+    actor->name = name;
+    actor->react = react;
+    actor->state = state;
+    actor->number_of_inputs = number_of_inputs;
+    for (size_t i = 0; i < number_of_inputs; i++) {
+        lf_actor_input_t* input = &actor->inputs[i];
+        input->head = 0;
+        input->count = 0;
+        input->connected = false;
+        input->present = false;
+    }
+    actor->number_of_links = 0;
+    actor->number_of_senders = 0;
+    actor->number_of_wakers = 0;
+    actor->waiting = false;
+    actor->has_timer = false;
+    actor->number_of_events = 0;
+    actor->tags_processed = 0;
+    if (lf_channel_init(&actor->inbox) != 0) {
+        return -1;
+    }
+    return lf_channel_init(&actor->wake);
+}
+
+void lf_actor_timer(lf_actor_t* actor, interval_t offset, interval_t period) {
+    actor->has_timer = true;
+    actor->offset = offset;
+    actor->period = period;
+}
+
+int lf_actor_connect(lf_actor_t* from, int output, lf_actor_t* to, int input) {
+    xassert(from->number_of_links < LF_ACTOR_MAX_PORTS);
+    xassert((size_t) input < to->number_of_inputs);
+    int sender = -1;
+    for (size_t i = 0; i < from->number_of_senders; i++) {
+        if (from->downstream[i] == to) {
+            sender = i;
+        }
+    }
+    if (sender < 0) {
+        sender = from->number_of_senders;
+        if (lf_channel_connect(&to->inbox, &from->senders[sender]) != 0) {
+            return -1;
+        }
+        from->downstream[sender] = to;
+        from->number_of_senders++;
+    }
+    int waker = -1;
+    for (size_t i = 0; i < to->number_of_wakers; i++) {
+        if (to->upstream[i] == from) {
+            waker = i;
+        }
+    }
+    if (waker < 0) {
+        waker = to->number_of_wakers;
+        if (lf_channel_connect(&from->wake, &to->wakers[waker]) != 0) {
+            return -1;
+        }
+        to->upstream[waker] = from;
+        to->number_of_wakers++;
+    }
+    lf_actor_link_t* link = &from->links[from->number_of_links++];
+    link->output = output;
+    link->to = to;
+    link->input = input;
+    link->sender = sender;
+    to->inputs[input].connected = true;
+    to->inputs[input].from = from;
+    to->inputs[input].waker = waker;
+    return 0;
+}
+
+void lf_actor_free(lf_actor_t* actor) {
+    for (size_t i = 0; i < actor->number_of_senders; i++) {
+        lf_channel_disconnect(&actor->senders[i]);
+    }
+    for (size_t i = 0; i < actor->number_of_wakers; i++) {
+        lf_channel_disconnect(&actor->wakers[i]);
+    }
+    lf_channel_free(&actor->inbox);
+    lf_channel_free(&actor->wake);
+}
+
+interval_t lf_actor_elapsed_time(lf_actor_t* actor) {
+    return actor->current_tag.time - _lf_actor_start_time;
+}
+
+int lf_actor_schedule(lf_actor_t* actor, interval_t delay) {
+    if (actor->number_of_events == LF_ACTOR_MAX_EVENTS) {
+        return -1;
+    }
+    lf_actor_tag_t tag = _lf_actor_tag_delay(actor->current_tag, delay);
+    // Insertion sort, keeping the earliest event first.
+    size_t i = actor->number_of_events++;
+    while (i > 0 && _lf_actor_tag_compare(actor->events[i - 1], tag) > 0) {
+        actor->events[i] = actor->events[i - 1];
+        i--;
+    }
+    actor->events[i] = tag;
+    return 0;
+}
+
+static void _lf_actor_send(lf_actor_t* actor, lf_actor_link_t* link, uintptr_t kind,
+        lf_actor_tag_t tag, uintptr_t value) {
+    uintptr_t words[MESSAGE_WORDS] = {
+        (kind << 16) | (uintptr_t) link->input,
+        (uintptr_t) (uint32_t) ((uint64_t) tag.time >> 32),
+        (uintptr_t) (uint32_t) tag.time,
+        (uintptr_t) tag.microstep,
+        value
+    };
+    lf_channel_send_words(&actor->senders[link->sender], words, MESSAGE_WORDS);
+}
+
+/**
+ * Block until the receiver of 'link' might have released a buffer of 'input'.
+ * The actor announces that it waits and sleeps on its wake channel. The
+ * receiver that clears the announcement sends exactly one wake-up, so at
+ * most one is in flight and sending it never blocks the receiver.
+ */
+static void _lf_actor_wait_for_release(lf_actor_t* actor, lf_actor_link_t* link, lf_actor_input_t* input) {
+    actor->waiting = true;
+    _LF_MEMORY_BARRIER();
+    if (link->sent - input->released < LF_ACTOR_PIPELINE_DEPTH
+            && lf_bool_compare_and_swap(&actor->waiting, true, false)) {
+        // Released in the meantime, before any receiver saw the announcement.
+        return;
+    }
+    lf_channel_receive(&actor->wake);
+}
+
+/**
+ * Release the buffers of 'count' processed messages of 'input' and wake the
+ * sender if it waits.
+ */
+static void _lf_actor_release(lf_actor_t* actor, lf_actor_input_t* input, uint32_t count) {
+    input->released += count;
+    _LF_MEMORY_BARRIER();
+    if (input->from->waiting && lf_bool_compare_and_swap(&input->from->waiting, true, false)) {
+        lf_channel_send(&actor->wakers[input->waker], 0);
+    }
+}
+
+void lf_actor_set(lf_actor_t* actor, int output, uintptr_t value) {
+    for (size_t i = 0; i < actor->number_of_links; i++) {
+        lf_actor_link_t* link = &actor->links[i];
+        if (link->output == output) {
+            // Wait for a free buffer at the receiving input.
+            lf_actor_input_t* input = &link->to->inputs[link->input];
+            while (link->sent - input->released >= LF_ACTOR_PIPELINE_DEPTH) {
+                _lf_actor_wait_for_release(actor, link, input);
+            }
+            link->sent++;
+            _lf_actor_send(actor, link, MESSAGE_DATA, actor->current_tag, value);
+        }
+    }
+}
+
+/**
+ * Receive one message from the inbox and record it at its input.
+ */
+static void _lf_actor_receive(lf_actor_t* actor) {
+    uintptr_t words[MESSAGE_WORDS];
+    lf_channel_receive_words(&actor->inbox, words, MESSAGE_WORDS);
+    lf_actor_input_t* input = &actor->inputs[words[0] & 0xFFFF];
+    lf_actor_tag_t tag = {
+        (instant_t) (((uint64_t) (uint32_t) words[1] << 32) | (uint32_t) words[2]),
+        (microstep_t) words[3]
+    };
+    if ((words[0] >> 16) == MESSAGE_PROMISE) {
+        if (_lf_actor_tag_compare(tag, input->promised) > 0) {
+            input->promised = tag;
+        }
+        return;
+    }
+    // The sender waits for a free buffer before sending.
+    xassert(input->count < LF_ACTOR_PIPELINE_DEPTH);
+    lf_actor_message_t* message = &input->pending[(input->head + input->count) % LF_ACTOR_PIPELINE_DEPTH];
+    message->tag = tag;
+    message->value = words[4];
+    input->count++;
+}
+
+/**
+ * Return the earliest tag at which the actor knows it has something to do.
+ */
+static lf_actor_tag_t _lf_actor_next_known(lf_actor_t* actor) {
+    lf_actor_tag_t next = FOREVER_TAG;
+    if (actor->has_timer) {
+        next = actor->next_timer;
+    }
+    if (actor->number_of_events > 0) {
+        next = _lf_actor_tag_min(next, actor->events[0]);
+    }
+    for (size_t i = 0; i < actor->number_of_inputs; i++) {
+        lf_actor_input_t* input = &actor->inputs[i];
+        if (input->count > 0) {
+            next = _lf_actor_tag_min(next, input->pending[input->head].tag);
+        }
+    }
+    return next;
+}
+
+/**
+ * Return the earliest tag at which a message that has not arrived yet could
+ * still be received.
+ */
+static lf_actor_tag_t _lf_actor_horizon(lf_actor_t* actor) {
+    lf_actor_tag_t horizon = FOREVER_TAG;
+    for (size_t i = 0; i < actor->number_of_inputs; i++) {
+        lf_actor_input_t* input = &actor->inputs[i];
+        if (input->connected && input->count == 0) {
+            horizon = _lf_actor_tag_min(horizon, input->promised);
+        }
+    }
+    return horizon;
+}
+
+/**
+ * Promise downstream actors that nothing will be sent before 'tag'.
+ */
+static void _lf_actor_promise(lf_actor_t* actor, lf_actor_tag_t tag) {
+    for (size_t i = 0; i < actor->number_of_links; i++) {
+        lf_actor_link_t* link = &actor->links[i];
+        if (_lf_actor_tag_compare(tag, link->promised) > 0) {
+            link->promised = tag;
+            _lf_actor_send(actor, link, MESSAGE_PROMISE, tag, 0);
+        }
+    }
+}
+
+/**
+ * Process all inputs and events at 'tag'.
+ */
+static void _lf_actor_process(lf_actor_t* actor, lf_actor_tag_t tag) {
+    if (!_lf_actor_fast) {
+        lf_sleep_until(tag.time);
+    }
+    actor->current_tag = tag;
+    for (size_t i = 0; i < actor->number_of_inputs; i++) {
+        lf_actor_input_t* input = &actor->inputs[i];
+        input->present = input->count > 0 && _lf_actor_tag_compare(input->pending[input->head].tag, tag) == 0;
+        if (input->present) {
+            input->value = input->pending[input->head].value;
+            input->head = (input->head + 1) % LF_ACTOR_PIPELINE_DEPTH;
+            input->count--;
+            // Only one message per tag arrives on a connection.
+            lf_actor_tag_t after = _lf_actor_tag_delay(tag, 0);
+            if (_lf_actor_tag_compare(after, input->promised) > 0) {
+                input->promised = after;
+            }
+        }
+    }
+    actor->timer_fired = actor->has_timer && _lf_actor_tag_compare(actor->next_timer, tag) == 0;
+    if (actor->timer_fired) {
+        actor->next_timer = actor->period > 0
+            ? (lf_actor_tag_t) { tag.time + actor->period, 0 }
+            : FOREVER_TAG;
+    }
+    actor->event_fired = false;
+    while (actor->number_of_events > 0 && _lf_actor_tag_compare(actor->events[0], tag) == 0) {
+        actor->event_fired = true;
+        actor->number_of_events--;
+        for (size_t i = 0; i < actor->number_of_events; i++) {
+            actor->events[i] = actor->events[i + 1];
+        }
+    }
+    actor->react(actor);
+    actor->tags_processed++;
+    // The buffers of the inputs processed at this tag can be reused.
+    for (size_t i = 0; i < actor->number_of_inputs; i++) {
+        if (actor->inputs[i].present) {
+            _lf_actor_release(actor, &actor->inputs[i], 1);
+        }
+    }
+}
+
+/**
+ * Event loop of an actor.
+ */
+static void* _lf_actor_main(void* arguments) {
+    lf_actor_t* actor = (lf_actor_t*) arguments;
+    while (true) {
+        lf_actor_tag_t next = _lf_actor_next_known(actor);
+        lf_actor_tag_t horizon = _lf_actor_horizon(actor);
+        if (_lf_actor_tag_compare(horizon, next) <= 0) {
+            // A message at or before 'next' might still arrive.
+            if (horizon.time > _lf_actor_stop_time) {
+                break;
+            }
+            _lf_actor_promise(actor, horizon);
+            _lf_actor_receive(actor);
+            continue;
+        }
+        if (next.time > _lf_actor_stop_time) {
+            break;
+        }
+        _lf_actor_process(actor, next);
+        _lf_actor_promise(actor, _lf_actor_tag_min(_lf_actor_next_known(actor), _lf_actor_horizon(actor)));
+    }
+    _lf_actor_promise(actor, FOREVER_TAG);
+    // Drain messages that were sent for tags after the stop time so that
+    // senders blocked on a full channel can finish.
+    while (_lf_actor_tag_compare(_lf_actor_horizon(actor), FOREVER_TAG) < 0) {
+        _lf_actor_receive(actor);
+        for (size_t i = 0; i < actor->number_of_inputs; i++) {
+            if (actor->inputs[i].count > 0) {
+                _lf_actor_release(actor, &actor->inputs[i], actor->inputs[i].count);
+                actor->inputs[i].count = 0;
+            }
+        }
+    }
+    return NULL;
+}
+
+int lf_actor_run(lf_actor_t** actors, size_t number_of_actors, interval_t timeout, bool fast) {
+    lf_clock_gettime(&_lf_actor_start_time);
+    _lf_actor_stop_time = timeout >= 0 ? _lf_actor_start_time + timeout : LF_ACTOR_FOREVER;
+    _lf_actor_fast = fast;
+    lf_actor_tag_t start = { _lf_actor_start_time, 0 };
+    for (size_t i = 0; i < number_of_actors; i++) {
+        lf_actor_t* actor = actors[i];
+        actor->current_tag = start;
+        actor->next_timer = actor->has_timer
+            ? (lf_actor_tag_t) { _lf_actor_start_time + actor->offset, 0 }
+            : FOREVER_TAG;
+        for (size_t j = 0; j < actor->number_of_inputs; j++) {
+            actor->inputs[j].promised = start;
+            actor->inputs[j].released = 0;
+        }
+        for (size_t j = 0; j < actor->number_of_links; j++) {
+            actor->links[j].promised = start;
+            actor->links[j].sent = 0;
+        }
+    }
+    for (size_t i = 0; i < number_of_actors; i++) {
+        if (lf_thread_create(&actors[i]->thread, &_lf_actor_main, actors[i]) != 0) {
+            return -1;
+        }
+    }
+    for (size_t i = 0; i < number_of_actors; i++) {
+        lf_thread_join(actors[i]->thread, NULL);
+    }
+    return 0;
+}
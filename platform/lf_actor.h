@@ -0,0 +1,221 @@
+#pragma once
+
+/**
+ * Actor execution engine.
+ *
+ * A standalone library that fits the XCore model of one task per hardware
+ * thread, next to the shared-queue runtime in reactor_threaded.c. Each actor
+ * runs its own event loop on a dedicated thread and stands for what would be
+ * a top-level reactor or a group of reactors. Port connections are tagged messages over channels (lf_channel.h).
+ * There is no global mutex and no shared event queue.
+ *
+ * Tags advance in a decentralized way. Messages on a connection arrive in tag
+ * order. After processing a tag, an actor promises each downstream actor the
+ * earliest tag at which it could still send, which lets the downstream actor
+ * process tags at which that input is absent. An actor processes its next
+ * tag once every input either has a message at or after that tag or has
+ * been promised past it. Connections must not form cycles.
+ *
+ * Consecutive tags are pipelined: an actor can process the next tag while
+ * its downstream actors still process earlier ones. Each input buffers the
+ * messages of up to LF_ACTOR_PIPELINE_DEPTH tags, and a sender waits before
+ * sending at a further tag until the receiver has finished processing the
+ * oldest one. With the default depth of 2, port state is double-buffered.
+ * A depth of 1 runs connected actors in lockstep. A waiting sender blocks on
+ * a channel of its own, over which the receiver wakes it up.
+ *
+ * Actors are wired up by hand in C. LF programs cannot use this engine: the
+ * build script does not copy it into generated programs, and nothing maps
+ * the reactors of a program to actors.
+ *
+ * Compile definitions:
+ *  - LF_ACTOR_MAX_PORTS: Maximum number of inputs and of outgoing
+ *    connections per actor (default 8).
+ *  - LF_ACTOR_MAX_EVENTS: Maximum number of pending scheduled events per
+ *    actor (default 8).
+ *  - LF_ACTOR_PIPELINE_DEPTH: Number of tags buffered per input (default 2).
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lf_platform.h"
+#include "lf_channel.h"
+
+#ifndef LF_ACTOR_MAX_PORTS
+#define LF_ACTOR_MAX_PORTS 8
+#endif
+
+#ifndef LF_ACTOR_MAX_EVENTS
+#define LF_ACTOR_MAX_EVENTS 8
+#endif
+
+#ifndef LF_ACTOR_PIPELINE_DEPTH
+#define LF_ACTOR_PIPELINE_DEPTH 2
+#endif
+
+#define LF_ACTOR_FOREVER INT64_MAX
+
+/**
+ * Tag of the actor engine. Like tag_t, but kept separate so that the engine
+ * does not depend on the reactor runtime.
+ */
+typedef struct {
+    instant_t time;
+    microstep_t microstep;
+} lf_actor_tag_t;
+
+typedef struct lf_actor_t lf_actor_t;
+
+/**
+ * Function invoked once for every tag at which an actor has an input or an
+ * event. It can read inputs and set outputs of the actor.
+ */
+typedef void (*lf_actor_react_t)(lf_actor_t* actor);
+
+typedef struct {
+    lf_actor_tag_t tag;
+    uintptr_t value;
+} lf_actor_message_t;
+
+typedef struct {
+    // Received messages that have not been processed yet, in tag order.
+    lf_actor_message_t pending[LF_ACTOR_PIPELINE_DEPTH];
+    size_t head;
+    size_t count;
+    // Number of messages processed, read by the sender to know when a
+    // buffer is free again.
+    volatile uint32_t released;
+    // Sending actor, and the index of the sending end to its wake channel.
+    lf_actor_t* from;
+    int waker;
+    // No message with a tag before this one will arrive anymore.
+    lf_actor_tag_t promised;
+    bool connected;
+    // Value at the current tag.
+    bool present;
+    uintptr_t value;
+} lf_actor_input_t;
+
+typedef struct {
+    int output;
+    lf_actor_t* to;
+    int input;
+    // Index of the sending end to 'to'.
+    int sender;
+    // Last promise sent over this connection.
+    lf_actor_tag_t promised;
+    // Number of messages sent over this connection.
+    uint32_t sent;
+} lf_actor_link_t;
+
+struct lf_actor_t {
+    const char* name;
+    lf_actor_react_t react;
+    // User state, available to the react function.
+    void* state;
+
+    lf_channel_t inbox;
+    // Channel on which the actor waits for a free buffer downstream, and
+    // whether it waits. A receiver that clears 'waiting' sends one wake-up.
+    lf_channel_t wake;
+    volatile bool waiting;
+    lf_actor_input_t inputs[LF_ACTOR_MAX_PORTS];
+    size_t number_of_inputs;
+
+    lf_actor_link_t links[LF_ACTOR_MAX_PORTS];
+    size_t number_of_links;
+    lf_actor_t* downstream[LF_ACTOR_MAX_PORTS];
+    lf_channel_sender_t senders[LF_ACTOR_MAX_PORTS];
+    size_t number_of_senders;
+    // Sending ends to the wake channels of upstream actors.
+    lf_actor_t* upstream[LF_ACTOR_MAX_PORTS];
+    lf_channel_sender_t wakers[LF_ACTOR_MAX_PORTS];
+    size_t number_of_wakers;
+
+    // Optional periodic timer.
+    bool has_timer;
+    interval_t offset;
+    interval_t period;
+    lf_actor_tag_t next_timer;
+    bool timer_fired;
+
+    // Events scheduled with lf_actor_schedule(), sorted by tag.
+    lf_actor_tag_t events[LF_ACTOR_MAX_EVENTS];
+    size_t number_of_events;
+    bool event_fired;
+
+    lf_actor_tag_t current_tag;
+    size_t tags_processed;
+    lf_thread_t thread;
+};
+
+/**
+ * Initialize an actor with 'number_of_inputs' inputs.
+ * @return 0 on success, -1 if no channel is available.
+ */
+int lf_actor_init(lf_actor_t* actor, const char* name, lf_actor_react_t react, void* state,
+        size_t number_of_inputs);
+
+/**
+ * Give the actor a timer that fires at start time plus 'offset' and then
+ * every 'period' (or only once if 'period' is 0).
+ */
+void lf_actor_timer(lf_actor_t* actor, interval_t offset, interval_t period);
+
+/**
+ * Connect output 'output' of 'from' to input 'input' of 'to'.
+ * @return 0 on success, -1 if no channel is available.
+ */
+int lf_actor_connect(lf_actor_t* from, int output, lf_actor_t* to, int input);
+
+/**
+ * Run the actors, each on its own thread, until all of them are done.
+ * Tags after start time plus 'timeout' are not processed. If 'fast' is
+ * true, actors do not wait for physical time to reach the tag.
+ * @return 0 on success, -1 if a thread could not be created.
+ */
+int lf_actor_run(lf_actor_t** actors, size_t number_of_actors, interval_t timeout, bool fast);
+
+/**
+ * Release the channels of an actor.
+ */
+void lf_actor_free(lf_actor_t* actor);
+
+/**
+ * Schedule an event for the actor itself 'delay' after the current tag,
+ * or at the next microstep if 'delay' is 0.
+ * @return 0 on success, -1 if too many events are pending.
+ */
+int lf_actor_schedule(lf_actor_t* actor, interval_t delay);
+
+/**
+ * Return the time of the current tag relative to the start time.
+ */
+interval_t lf_actor_elapsed_time(lf_actor_t* actor);
+
+/**
+ * Set output 'output' to 'value' at the current tag.
+ */
+void lf_actor_set(lf_actor_t* actor, int output, uintptr_t value);
+
+static inline lf_actor_tag_t lf_actor_tag(lf_actor_t* actor) {
+    return actor->current_tag;
+}
+
+static inline bool lf_actor_is_present(lf_actor_t* actor, int input) {
+    return actor->inputs[input].present;
+}
+
+static inline uintptr_t lf_actor_get(lf_actor_t* actor, int input) {
+    return actor->inputs[input].value;
+}
+
+static inline bool lf_actor_timer_fired(lf_actor_t* actor) {
+    return actor->timer_fired;
+}
+
+static inline bool lf_actor_event_fired(lf_actor_t* actor) {
+    return actor->event_fired;
+}
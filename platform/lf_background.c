@@ -0,0 +1,233 @@
+#include "lf_background.h"
+
+#ifdef LF_BACKGROUND_THREADS
+
+#include <stdlib.h>
+
+#include "lf_channel.h"
+#include "../reactor.h"
+#include "../utils/util.h"
+
+#ifndef LF_HOST_STAND_IN
+#include <xcore/assert.h>
+#endif
+
+extern lf_mutex_t mutex;
+
+typedef struct _lf_background_record_t {
+    lf_background_job_t job;
+    void* arg;
+    void* action;
+    void* result;
+    struct _lf_background_record_t* next;
+} _lf_background_record_t;
+
+// Jobs are pushed onto a lock-free stack of the thread they are assigned to,
+// and the thread takes the whole stack when it is free. A thread with nothing
+// to do announces that it waits on 'wake'. The thread that takes the
+// announcement back with a compare-and-swap sends the wake-up, so there is at
+// most one send in flight per thread, and it has been received before the
+// thread can announce its next wait.
+typedef struct {
+    lf_channel_t wake;
+    // Sending end of 'wake'. Only used by the thread that took the
+    // announcement back.
+    lf_channel_sender_t to_thread;
+    // Stack of jobs assigned to this thread that it has not taken yet.
+    _lf_background_record_t* volatile submitted;
+    // Number of jobs assigned to this thread that have not finished. Only
+    // used to choose a thread.
+    volatile int queued;
+    volatile bool waiting;
+    volatile bool stopping;
+    lf_thread_t thread;
+} _lf_background_thread_t;
+
+static _lf_background_thread_t _lf_background_threads[LF_BACKGROUND_THREADS];
+
+// Stack of finished jobs, pushed by the background threads.
+static _lf_background_record_t* volatile _lf_background_done = NULL;
+
+static int _lf_background_outstanding = 0;
+
+// Number of runtime threads that wait for physical time and must be woken
+// when a job finishes. Only changed while the mutex is held.
+static volatile int _lf_background_sleepers = 0;
+
+static bool _lf_background_cas(_lf_background_record_t* volatile* ptr, _lf_background_record_t* oldval,
+        _lf_background_record_t* newval) {
+#ifdef LF_HOST_STAND_IN
+    return __sync_bool_compare_and_swap(ptr, oldval, newval);
+#else
+    // Pointers are 32 bits wide on XCore.
+    return lf_val_compare_and_swap((int*) ptr, (int) oldval, (int) newval) == (int) oldval;
+#endif
+}
+
+static void _lf_background_push(_lf_background_record_t* volatile* stack, _lf_background_record_t* record) {
+    _lf_background_record_t* head;
+    do {
+        head = *stack;
+        record->next = head;
+    } while (!_lf_background_cas(stack, head, record));
+}
+
+/**
+ * Empty 'stack' and return its records in the order they were pushed.
+ */
+static _lf_background_record_t* _lf_background_take(_lf_background_record_t* volatile* stack) {
+    _lf_background_record_t* head;
+    do {
+        head = *stack;
+    } while (head != NULL && !_lf_background_cas(stack, head, NULL));
+    _lf_background_record_t* ordered = NULL;
+    while (head != NULL) {
+        _lf_background_record_t* next = head->next;
+        head->next = ordered;
+        ordered = head;
+        head = next;
+    }
+    return ordered;
+}
+
+/**
+ * Wake 'thread' if it announced that it waits.
+ */
+static void _lf_background_wake(_lf_background_thread_t* thread) {
+    _LF_MEMORY_BARRIER();
+    if (thread->waiting && lf_bool_compare_and_swap(&thread->waiting, true, false)) {
+        lf_channel_send(&thread->to_thread, 0);
+    }
+}
+
+/**
+ * Block the calling background thread until it has a job or is stopped.
+ */
+static void _lf_background_wait(_lf_background_thread_t* self) {
+    self->waiting = true;
+    _LF_MEMORY_BARRIER();
+    if ((self->submitted != NULL || self->stopping)
+            && lf_bool_compare_and_swap(&self->waiting, true, false)) {
+        // Woken in the meantime, before any other thread saw the announcement.
+        return;
+    }
+    lf_channel_receive(&self->wake);
+}
+
+static void* _lf_background_main(void* arg) {
+    _lf_background_thread_t* self = (_lf_background_thread_t*) arg;
+    while (self->submitted != NULL || !self->stopping) {
+        _lf_background_record_t* record = _lf_background_take(&self->submitted);
+        while (record != NULL) {
+            _lf_background_record_t* next = record->next;
+            record->result = record->job(record->arg);
+            _lf_background_push(&_lf_background_done, record);
+            lf_atomic_fetch_add(&self->queued, -1);
+            // A runtime thread that waits for physical time has announced it
+            // before it last looked for finished jobs, and holds the mutex
+            // until it waits on event_q_changed. Otherwise, the runtime
+            // collects the job when it advances the tag.
+            _LF_MEMORY_BARRIER();
+            if (_lf_background_sleepers > 0) {
+                lf_mutex_lock(&mutex);
+                lf_notify_of_event();
+                lf_mutex_unlock(&mutex);
+            }
+            record = next;
+        }
+        _lf_background_wait(self);
+    }
+    return NULL;
+}
+
+void lf_background_init(void) {
+    for (int i = 0; i < LF_BACKGROUND_THREADS; i++) {
+        _lf_background_thread_t* thread = &_lf_background_threads[i];
+        if (lf_channel_init(&thread->wake) != 0
+                || lf_channel_connect(&thread->wake, &thread->to_thread) != 0) {
+            lf_print_error_and_exit("Background jobs: Out of channel resources.");
+        }
+        thread->submitted = NULL;
+        thread->queued = 0;
+        thread->waiting = false;
+        thread->stopping = false;
+        lf_thread_create(&thread->thread, &_lf_background_main, thread);
+    }
+}
+
+void lf_background_free(void) {
+    for (int i = 0; i < LF_BACKGROUND_THREADS; i++) {
+        // A thread exits once it has run the jobs assigned to it.
+        _lf_background_thread_t* thread = &_lf_background_threads[i];
+        thread->stopping = true;
+        _lf_background_wake(thread);
+    }
+    for (int i = 0; i < LF_BACKGROUND_THREADS; i++) {
+        _lf_background_thread_t* thread = &_lf_background_threads[i];
+        lf_thread_join(thread->thread, NULL);
+        lf_channel_disconnect(&thread->to_thread);
+        lf_channel_free(&thread->wake);
+    }
+    _lf_background_record_t* record = _lf_background_take(&_lf_background_done);
+    while (record != NULL) {
+        _lf_background_record_t* next = record->next;
+        free(record->result);
+        free(record);
+        record = next;
+    }
+}
+
+int lf_background_run(void* action, lf_background_job_t job, void* arg) {
+    _lf_background_record_t* record = (_lf_background_record_t*) malloc(sizeof(_lf_background_record_t));
+    if (record == NULL) {
+        return -1;
+    }
+    record->job = job;
+    record->arg = arg;
+    record->action = action;
+    record->result = NULL;
+    // Pick the thread with the fewest unfinished jobs.
+    _lf_background_thread_t* thread = &_lf_background_threads[0];
+    for (int i = 1; i < LF_BACKGROUND_THREADS; i++) {
+        if (_lf_background_threads[i].queued < thread->queued) {
+            thread = &_lf_background_threads[i];
+        }
+    }
+    lf_atomic_fetch_add(&thread->queued, 1);
+    lf_atomic_fetch_add(&_lf_background_outstanding, 1);
+    _lf_background_push(&thread->submitted, record);
+    _lf_background_wake(thread);
+    return 0;
+}
+
+void lf_background_sleeping_locked(bool sleeping) {
+    _lf_background_sleepers += sleeping ? 1 : -1;
+    _LF_MEMORY_BARRIER();
+}
+
+int lf_background_collect_locked(void) {
+    // Schedule the actions in the order the jobs finished.
+    _lf_background_record_t* record = _lf_background_take(&_lf_background_done);
+    int count = 0;
+    while (record != NULL) {
+        _lf_background_record_t* next = record->next;
+        if (record->result != NULL) {
+            _lf_schedule_value(record->action, 0, record->result, 1);
+        } else {
+            _lf_schedule_token(record->action, 0, NULL);
+        }
+        free(record);
+        record = next;
+        count++;
+    }
+    if (count > 0) {
+        lf_atomic_fetch_add(&_lf_background_outstanding, -count);
+    }
+    return count;
+}
+
+int lf_background_outstanding(void) {
+    return _lf_background_outstanding;
+}
+
+#endif // LF_BACKGROUND_THREADS
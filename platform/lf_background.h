@@ -0,0 +1,76 @@
+#pragma once
+
+/**
+ * Background jobs.
+ *
+ * A reaction can hand a long computation to a pool of background threads
+ * with lf_background_run() and return right away, so that tags keep
+ * advancing while the job runs. When the job finishes, the physical action
+ * given to lf_background_run() is scheduled with the result of the job.
+ *
+ * Jobs are pushed onto a lock-free stack of one of the background threads,
+ * so lf_background_run() never blocks on a running job. An idle background
+ * thread is woken over a channel (lf_channel.h). A finished job is pushed
+ * onto another lock-free stack, and the runtime collects the stack and
+ * schedules the actions when it advances the tag. Neither takes the global
+ * mutex, except that a finished job takes it to wake the runtime while the
+ * runtime waits for physical time.
+ *
+ * Compile definitions:
+ *  - LF_BACKGROUND_THREADS: Number of background threads. Background jobs
+ *    are only available if this is defined. On XMOS, each one takes a
+ *    hardware thread and two chanends.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "lf_platform.h"
+
+/**
+ * A background job. It returns a pointer to its result, allocated with
+ * malloc() and holding a value of the type of the physical action, or NULL
+ * to schedule the action without a value.
+ */
+typedef void* (*lf_background_job_t)(void* arg);
+
+/**
+ * Run 'job' with 'arg' on a background thread and schedule the physical
+ * action 'action' with its result when it is done. Can be called from
+ * reactions.
+ * @return 0 on success, -1 if out of memory.
+ */
+int lf_background_run(void* action, lf_background_job_t job, void* arg);
+
+/**
+ * Start the background threads. Called by the runtime before the workers
+ * start.
+ */
+void lf_background_init(void);
+
+/**
+ * Stop the background threads after their current job and discard results
+ * that have not been collected. Called by the runtime after the workers
+ * exited.
+ */
+void lf_background_free(void);
+
+/**
+ * Announce that the calling thread starts (true) or stopped (false) waiting
+ * for physical time on event_q_changed, so that finished jobs notify it.
+ * Start before the last call to lf_background_collect_locked() ahead of the
+ * wait. This assumes the mutex is held.
+ */
+void lf_background_sleeping_locked(bool sleeping);
+
+/**
+ * Schedule the actions of the jobs that finished since the last call.
+ * This assumes the mutex is held.
+ * @return The number of jobs collected.
+ */
+int lf_background_collect_locked(void);
+
+/**
+ * Return the number of jobs that have been started and not collected.
+ */
+int lf_background_outstanding(void);
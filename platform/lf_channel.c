@@ -0,0 +1,130 @@
+#include "lf_channel.h"
+#include "lf_platform.h"
+
+#ifdef LF_HOST_STAND_IN
+#include <errno.h>
+#include <unistd.h>
+
+int lf_channel_init(lf_channel_t* channel) {
+    xassert(channel);
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return -1;
+    }
+    channel->read_fd = fds[0];
+    channel->write_fd = fds[1];
+    return 0;
+}
+
+int lf_channel_connect(lf_channel_t* channel, lf_channel_sender_t* sender) {
+    xassert(channel && sender);
+    // Writes of one word to a pipe are atomic, so all senders share the write end.
+    sender->fd = channel->write_fd;
+    return 0;
+}
+
+void lf_channel_send(lf_channel_sender_t* sender, uintptr_t word) {
+    ssize_t written;
+    do {
+        written = write(sender->fd, &word, sizeof(word));
+    } while (written < 0 && errno == EINTR);
+    xassert(written == sizeof(word));
+}
+
+uintptr_t lf_channel_receive(lf_channel_t* channel) {
+    uintptr_t word;
+    ssize_t received;
+    do {
+        received = read(channel->read_fd, &word, sizeof(word));
+    } while (received < 0 && errno == EINTR);
+    xassert(received == sizeof(word));
+    return word;
+}
+
+void lf_channel_send_words(lf_channel_sender_t* sender, const uintptr_t* words, size_t length) {
+    // A single write of up to PIPE_BUF bytes is atomic.
+    ssize_t written;
+    do {
+        written = write(sender->fd, words, sizeof(uintptr_t) * length);
+    } while (written < 0 && errno == EINTR);
+    xassert(written == (ssize_t) (sizeof(uintptr_t) * length));
+}
+
+void lf_channel_receive_words(lf_channel_t* channel, uintptr_t* words, size_t length) {
+    size_t remaining = sizeof(uintptr_t) * length;
+    char* buffer = (char*) words;
+    while (remaining > 0) {
+        ssize_t received = read(channel->read_fd, buffer, remaining);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        xassert(received > 0);
+        buffer += received;
+        remaining -= received;
+    }
+}
+
+void lf_channel_disconnect(lf_channel_sender_t* sender) {
+    sender->fd = -1;
+}
+
+void lf_channel_free(lf_channel_t* channel) {
+    close(channel->read_fd);
+    close(channel->write_fd);
+}
+
+#else
+#include <xcore/assert.h>
+
+int lf_channel_init(lf_channel_t* channel) {
+    xassert(channel);
+    channel->end = chanend_alloc();
+    return channel->end ? 0 : -1;
+}
+
+int lf_channel_connect(lf_channel_t* channel, lf_channel_sender_t* sender) {
+    xassert(channel && sender);
+    sender->end = chanend_alloc();
+    if (!sender->end) {
+        return -1;
+    }
+    chanend_set_dest(sender->end, channel->end);
+    return 0;
+}
+
+void lf_channel_send(lf_channel_sender_t* sender, uintptr_t word) {
+    chanend_out_word(sender->end, (uint32_t) word);
+    // Release the route so that other senders can reach the receiver.
+    chanend_out_end_token(sender->end);
+}
+
+uintptr_t lf_channel_receive(lf_channel_t* channel) {
+    uint32_t word = chanend_in_word(channel->end);
+    chanend_check_end_token(channel->end);
+    return (uintptr_t) word;
+}
+
+void lf_channel_send_words(lf_channel_sender_t* sender, const uintptr_t* words, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        chanend_out_word(sender->end, (uint32_t) words[i]);
+    }
+    // The route is held until the END token, so the message is not interleaved.
+    chanend_out_end_token(sender->end);
+}
+
+void lf_channel_receive_words(lf_channel_t* channel, uintptr_t* words, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        words[i] = (uintptr_t) chanend_in_word(channel->end);
+    }
+    chanend_check_end_token(channel->end);
+}
+
+void lf_channel_disconnect(lf_channel_sender_t* sender) {
+    chanend_free(sender->end);
+}
+
+void lf_channel_free(lf_channel_t* channel) {
+    chanend_free(channel->end);
+}
+
+#endif
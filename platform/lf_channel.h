@@ -0,0 +1,88 @@
+#pragma once
+
+/**
+ * Word-sized message channels between threads.
+ *
+ * A channel has one receiving end and any number of sending ends, each of
+ * which must only be used by one thread at a time. Messages from one sender
+ * arrive in the order they were sent. Sends only block while the channel
+ * buffer is full.
+ *
+ * On XMOS, the receiving end is a chanend and each sending end is a chanend
+ * routed to it. Every message is terminated by an END control token so that
+ * the route is released for the other senders. On the host stand-in, a
+ * channel is a pipe.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef LF_HOST_STAND_IN
+typedef struct {
+    int read_fd;
+    int write_fd;
+} lf_channel_t;
+
+typedef struct {
+    int fd;
+} lf_channel_sender_t;
+#else
+#include <xcore/chanend.h>
+
+typedef struct {
+    chanend_t end;
+} lf_channel_t;
+
+typedef struct {
+    chanend_t end;
+} lf_channel_sender_t;
+#endif
+
+/**
+ * Initialize the receiving end of a channel.
+ *
+ * @return 0 on success, -1 if no channel resource is available.
+ */
+int lf_channel_init(lf_channel_t* channel);
+
+/**
+ * Initialize a sending end that delivers to 'channel'.
+ *
+ * @return 0 on success, -1 if no channel resource is available.
+ */
+int lf_channel_connect(lf_channel_t* channel, lf_channel_sender_t* sender);
+
+/**
+ * Send one word.
+ */
+void lf_channel_send(lf_channel_sender_t* sender, uintptr_t word);
+
+/**
+ * Block until a word is available on the channel and return it.
+ */
+uintptr_t lf_channel_receive(lf_channel_t* channel);
+
+/**
+ * Send a message of 'length' words. Messages from different senders are
+ * not interleaved. The message must fit in the channel buffer of the host
+ * stand-in (PIPE_BUF bytes).
+ */
+void lf_channel_send_words(lf_channel_sender_t* sender, const uintptr_t* words, size_t length);
+
+/**
+ * Block until a message of 'length' words, sent with lf_channel_send_words(),
+ * is available and store it in 'words'.
+ */
+void lf_channel_receive_words(lf_channel_t* channel, uintptr_t* words, size_t length);
+
+/**
+ * Release the resources of a sending end.
+ */
+void lf_channel_disconnect(lf_channel_sender_t* sender);
+
+/**
+ * Release the resources of a channel. All sending ends must have been
+ * disconnected.
+ */
+void lf_channel_free(lf_channel_t* channel);
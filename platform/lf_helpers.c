@@ -0,0 +1,159 @@
+#include "lf_helpers.h"
+
+#ifdef LF_HELPER_THREADS
+
+#include "lf_channel.h"
+#include "lf_platform.h"
+
+#ifdef LF_HOST_STAND_IN
+#include <pthread.h>
+#else
+#include <xcore/assert.h>
+#include <xcore/lock.h>
+#include <xcore/thread.h>
+#endif
+
+typedef struct {
+    lf_channel_t inbox;
+    // Sending end of 'inbox', used by the main thread.
+    lf_channel_sender_t to_helper;
+    // Sending end of the completion channel, used by the helper.
+    lf_channel_sender_t to_main;
+#ifdef LF_HOST_STAND_IN
+    pthread_t thread;
+#else
+    xthread_t thread;
+#endif
+} _lf_helper_t;
+
+static _lf_helper_t _lf_helpers[LF_HELPER_THREADS];
+static lf_channel_t _lf_helpers_done;
+static lf_helper_function_t _lf_helpers_function;
+
+#ifdef LF_HOST_STAND_IN
+static pthread_mutex_t _lf_helpers_lock = PTHREAD_MUTEX_INITIALIZER;
+#else
+static uint32_t _lf_helpers_stacks[LF_HELPER_THREADS][LF_HELPER_STACK_WORDS];
+static lock_t _lf_helpers_lock;
+#endif
+// Whether the helpers run. Before and after, only the main thread runs and
+// lf_helpers_lock() does not need the lock, which is not allocated yet.
+static bool _lf_helpers_running = false;
+
+/**
+ * Main loop of a helper. A NULL item stops it.
+ */
+static void _lf_helpers_main(void* arg) {
+    _lf_helper_t* helper = (_lf_helper_t*) arg;
+    void* item;
+    while ((item = (void*) lf_channel_receive(&helper->inbox)) != NULL) {
+        _lf_helpers_function(item);
+        lf_channel_send(&helper->to_main, (uintptr_t) item);
+    }
+}
+
+#ifdef LF_HOST_STAND_IN
+static void* _lf_helpers_pthread_main(void* arg) {
+    _lf_helpers_main(arg);
+    return NULL;
+}
+#endif
+
+int lf_helpers_init(lf_helper_function_t function) {
+    _lf_helpers_function = function;
+#ifndef LF_HOST_STAND_IN
+    _lf_helpers_lock = lock_alloc();
+    if (!_lf_helpers_lock) {
+        return -1;
+    }
+#endif
+    _lf_helpers_running = true;
+    if (lf_channel_init(&_lf_helpers_done) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < LF_HELPER_THREADS; i++) {
+        _lf_helper_t* helper = &_lf_helpers[i];
+        if (lf_channel_init(&helper->inbox) != 0
+                || lf_channel_connect(&helper->inbox, &helper->to_helper) != 0
+                || lf_channel_connect(&_lf_helpers_done, &helper->to_main) != 0) {
+            return -1;
+        }
+#ifdef LF_HOST_STAND_IN
+        if (pthread_create(&helper->thread, NULL, &_lf_helpers_pthread_main, helper) != 0) {
+            return -1;
+        }
+#else
+        helper->thread = xthread_alloc_and_start(&_lf_helpers_main, helper,
+                stack_base(_lf_helpers_stacks[i], LF_HELPER_STACK_WORDS));
+        if (!helper->thread) {
+            return -1;
+        }
+#endif
+    }
+    return 0;
+}
+
+void lf_helpers_free(void) {
+    for (int i = 0; i < LF_HELPER_THREADS; i++) {
+        _lf_helper_t* helper = &_lf_helpers[i];
+        lf_channel_send(&helper->to_helper, (uintptr_t) NULL);
+#ifdef LF_HOST_STAND_IN
+        pthread_join(helper->thread, NULL);
+#else
+        xthread_wait_and_free(helper->thread);
+#endif
+        lf_channel_disconnect(&helper->to_helper);
+        lf_channel_disconnect(&helper->to_main);
+        lf_channel_free(&helper->inbox);
+    }
+    lf_channel_free(&_lf_helpers_done);
+    _lf_helpers_running = false;
+#ifndef LF_HOST_STAND_IN
+    lock_free(_lf_helpers_lock);
+#endif
+}
+
+void lf_helpers_post(int helper, void* item) {
+    xassert(helper >= 0 && helper < LF_HELPER_THREADS && item != NULL);
+    lf_channel_send(&_lf_helpers[helper].to_helper, (uintptr_t) item);
+}
+
+void* lf_helpers_wait(void) {
+    return (void*) lf_channel_receive(&_lf_helpers_done);
+}
+
+int lf_helpers_fetch_add(int* ptr, int value) {
+#ifdef LF_HOST_STAND_IN
+    return __sync_fetch_and_add(ptr, value);
+#else
+    lf_helpers_lock();
+    int result = *ptr;
+    *ptr += value;
+    lf_helpers_unlock();
+    return result;
+#endif
+}
+
+void lf_helpers_lock(void) {
+    if (!_lf_helpers_running) {
+        return;
+    }
+#ifdef LF_HOST_STAND_IN
+    pthread_mutex_lock(&_lf_helpers_lock);
+#else
+    lock_acquire(_lf_helpers_lock);
+#endif
+}
+
+void lf_helpers_unlock(void) {
+    if (!_lf_helpers_running) {
+        return;
+    }
+#ifdef LF_HOST_STAND_IN
+    pthread_mutex_unlock(&_lf_helpers_lock);
+#else
+    lock_release(_lf_helpers_lock);
+#endif
+}
+
+#endif // LF_HELPER_THREADS
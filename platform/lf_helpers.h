@@ -0,0 +1,77 @@
+#pragma once
+
+/**
+ * Helper threads for the unthreaded runtime (reactor.c).
+ *
+ * With LF_HELPER_THREADS defined, the unthreaded runtime starts that many
+ * helper threads and, whenever several reactions of the same level are
+ * ready, runs them on the helpers in parallel with the main thread. Work is
+ * sent to each helper over its own channel and completions come back over a
+ * shared channel (lf_channel.h). There is no global mutex and no scheduler.
+ *
+ * Reactions on the helpers may create, schedule and drop tokens. The token
+ * recycling bin and allocation counters of the runtime are updated under
+ * lf_helpers_lock() and reference counts with lf_helpers_fetch_add(). The
+ * template tokens of ports and actions belong to one reactor, whose
+ * reactions never share a level.
+ *
+ * Helper threads are started directly on the platform, so the threaded
+ * platform support (NUMBER_OF_WORKERS) is not needed. On XMOS, each helper
+ * takes a hardware thread and two chanends.
+ *
+ * Compile definitions:
+ *  - LF_HELPER_THREADS: Number of helper threads.
+ *  - LF_HELPER_STACK_WORDS: Stack size of a helper thread on XMOS, in words
+ *    (default 256).
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef LF_HELPER_STACK_WORDS
+#define LF_HELPER_STACK_WORDS 256
+#endif
+
+/**
+ * Function executed by a helper for every item it receives.
+ */
+typedef void (*lf_helper_function_t)(void* item);
+
+/**
+ * Start the helper threads, which invoke 'function' on the items posted to them.
+ * @return 0 on success, -1 if a channel or thread is not available.
+ */
+int lf_helpers_init(lf_helper_function_t function);
+
+/**
+ * Stop the helper threads. No items may be outstanding.
+ */
+void lf_helpers_free(void);
+
+/**
+ * Hand 'item' to helper 'helper'. Only the main thread may post.
+ */
+void lf_helpers_post(int helper, void* item);
+
+/**
+ * Block until a helper is done with an item and return that item.
+ */
+void* lf_helpers_wait(void);
+
+/**
+ * Atomically add 'value' to '*ptr' and return the previous value.
+ * Safe to call from the main thread and from helpers.
+ */
+int lf_helpers_fetch_add(int* ptr, int value);
+
+/**
+ * Enter a short section that excludes the main thread and the helpers, for
+ * shared state of the runtime such as the token recycling bin. Sections do
+ * not nest and must not call lf_helpers_fetch_add().
+ */
+void lf_helpers_lock(void);
+
+/**
+ * Leave the section entered with lf_helpers_lock().
+ */
+void lf_helpers_unlock(void);
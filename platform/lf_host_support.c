@@ -0,0 +1,245 @@
+#include "lf_host_support.h"
+#include "lf_platform.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NSEC_PER_SEC 1000000000LL
+
+#ifdef NUMBER_OF_WORKERS
+// One and only mutex
+lf_mutex_t mutex;
+lf_cond_t event_q_changed;
+#endif
+
+void lf_initialize_clock(void) {
+}
+
+int lf_clock_gettime(instant_t* t) {
+    xassert(t);
+    struct timespec tp;
+    if (clock_gettime(_LF_CLOCK, &tp) != 0) {
+        return -1;
+    }
+    *t = ((instant_t) tp.tv_sec) * NSEC_PER_SEC + tp.tv_nsec;
+    return 0;
+}
+
+int lf_sleep(interval_t sleep_duration) {
+    struct timespec tp = {
+        (time_t) (sleep_duration / NSEC_PER_SEC),
+        (long) (sleep_duration % NSEC_PER_SEC)
+    };
+    while (nanosleep(&tp, &tp) != 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int lf_sleep_until(instant_t wakeup_time) {
+    instant_t now;
+    if (lf_clock_gettime(&now) != 0) {
+        return -1;
+    }
+    if (wakeup_time > now) {
+        return lf_sleep(wakeup_time - now);
+    }
+    return 0;
+}
+
+int lf_critical_section_enter() {
+#ifdef NUMBER_OF_WORKERS
+    return lf_mutex_lock(&mutex);
+#else
+    return 0;
+#endif
+}
+
+int lf_critical_section_exit() {
+#ifdef NUMBER_OF_WORKERS
+    return lf_mutex_unlock(&mutex);
+#else
+    return 0;
+#endif
+}
+
+int lf_notify_of_event() {
+#ifdef NUMBER_OF_WORKERS
+    return lf_cond_broadcast(&event_q_changed);
+#else
+    return 0;
+#endif
+}
+
+#ifdef NUMBER_OF_WORKERS
+static __thread lf_thread_context_t thread_context = {-1, 0, {NULL}};
+
+lf_thread_context_t* lf_thread_context() {
+    return &thread_context;
+}
+
+int lf_available_cores() {
+    return (int) sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+int lf_thread_create(lf_thread_t* thread, void *(*lf_thread) (void *), void* arguments) {
+    return pthread_create((pthread_t*) thread, NULL, lf_thread, arguments);
+}
+
+int lf_thread_join(lf_thread_t thread, void** thread_return) {
+    return pthread_join((pthread_t) thread, thread_return);
+}
+
+int lf_mutex_init(lf_mutex_t* mutex) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    int result = pthread_mutex_init((pthread_mutex_t*) mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    return result;
+}
+
+int lf_mutex_lock(lf_mutex_t* mutex) {
+    int result = pthread_mutex_lock((pthread_mutex_t*) mutex);
+    if (result == 0) {
+        thread_context.locks_held++;
+    }
+    return result;
+}
+
+int lf_mutex_unlock(lf_mutex_t* mutex) {
+    thread_context.locks_held--;
+    return pthread_mutex_unlock((pthread_mutex_t*) mutex);
+}
+
+int lf_cond_init(lf_cond_t* cond) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+#ifndef __APPLE__
+    pthread_condattr_setclock(&attr, _LF_CLOCK);
+#endif
+    int result = pthread_cond_init((pthread_cond_t*) cond, &attr);
+    pthread_condattr_destroy(&attr);
+    return result;
+}
+
+int lf_cond_broadcast(lf_cond_t* cond) {
+    return pthread_cond_broadcast((pthread_cond_t*) cond);
+}
+
+int lf_cond_signal(lf_cond_t* cond) {
+    return pthread_cond_signal((pthread_cond_t*) cond);
+}
+
+int lf_cond_wait(lf_cond_t* cond, lf_mutex_t* mutex) {
+    return pthread_cond_wait((pthread_cond_t*) cond, (pthread_mutex_t*) mutex);
+}
+
+int lf_cond_timedwait(lf_cond_t* cond, lf_mutex_t* mutex, instant_t absolute_time_ns) {
+    struct timespec tp = {
+        (time_t) (absolute_time_ns / NSEC_PER_SEC),
+        (long) (absolute_time_ns % NSEC_PER_SEC)
+    };
+    int result = pthread_cond_timedwait((pthread_cond_t*) cond, (pthread_mutex_t*) mutex, &tp);
+    if (result == ETIMEDOUT) {
+        return LF_TIMEOUT;
+    }
+    return result;
+}
+
+int lf_barrier_init(lf_barrier_t* barrier, int parties) {
+    barrier->parties = parties;
+    barrier->remaining = parties;
+    barrier->sense = 0;
+    barrier->wakeups = 0;
+    int result = pthread_mutex_init(&barrier->lock, NULL);
+    if (result == 0) {
+        result = pthread_cond_init(&barrier->changed, NULL);
+    }
+    return result;
+}
+
+void lf_barrier_free(lf_barrier_t* barrier) {
+    pthread_cond_destroy(&barrier->changed);
+    pthread_mutex_destroy(&barrier->lock);
+}
+
+bool lf_barrier_arrive(lf_barrier_t* barrier, int* sense) {
+    *sense = barrier->sense;
+    return __sync_sub_and_fetch(&barrier->remaining, 1) == 0;
+}
+
+void lf_barrier_release(lf_barrier_t* barrier) {
+    pthread_mutex_lock(&barrier->lock);
+    barrier->remaining = barrier->parties;
+    barrier->sense = !barrier->sense;
+    pthread_cond_broadcast(&barrier->changed);
+    pthread_mutex_unlock(&barrier->lock);
+}
+
+bool lf_barrier_wait(lf_barrier_t* barrier, int sense) {
+    pthread_mutex_lock(&barrier->lock);
+    unsigned wakeups = barrier->wakeups;
+    while (barrier->sense == sense && barrier->wakeups == wakeups) {
+        pthread_cond_wait(&barrier->changed, &barrier->lock);
+    }
+    bool released = barrier->sense != sense;
+    pthread_mutex_unlock(&barrier->lock);
+    return released;
+}
+
+void lf_barrier_wake(lf_barrier_t* barrier) {
+    pthread_mutex_lock(&barrier->lock);
+    barrier->wakeups++;
+    pthread_cond_broadcast(&barrier->changed);
+    pthread_mutex_unlock(&barrier->lock);
+}
+
+lf_semaphore_t* lf_semaphore_new(int count) {
+    lf_semaphore_t* semaphore = (lf_semaphore_t*) malloc(sizeof(lf_semaphore_t));
+    if (semaphore == NULL) {
+        return NULL;
+    }
+    semaphore->count = count;
+    pthread_mutex_init(&semaphore->lock, NULL);
+    pthread_cond_init(&semaphore->changed, NULL);
+    return semaphore;
+}
+
+void lf_semaphore_release(lf_semaphore_t* semaphore, int i) {
+    pthread_mutex_lock(&semaphore->lock);
+    semaphore->count += i;
+    pthread_cond_broadcast(&semaphore->changed);
+    pthread_mutex_unlock(&semaphore->lock);
+}
+
+void lf_semaphore_acquire(lf_semaphore_t* semaphore) {
+    pthread_mutex_lock(&semaphore->lock);
+    while (semaphore->count == 0) {
+        pthread_cond_wait(&semaphore->changed, &semaphore->lock);
+    }
+    semaphore->count--;
+    if (semaphore->count == 0) {
+        pthread_cond_broadcast(&semaphore->changed);
+    }
+    pthread_mutex_unlock(&semaphore->lock);
+}
+
+void lf_semaphore_wait(lf_semaphore_t* semaphore) {
+    pthread_mutex_lock(&semaphore->lock);
+    while (semaphore->count != 0) {
+        pthread_cond_wait(&semaphore->changed, &semaphore->lock);
+    }
+    pthread_mutex_unlock(&semaphore->lock);
+}
+
+void lf_semaphore_destroy(lf_semaphore_t* semaphore) {
+    pthread_cond_destroy(&semaphore->changed);
+    pthread_mutex_destroy(&semaphore->lock);
+    free(semaphore);
+}
+#endif
@@ -0,0 +1,76 @@
+#pragma once
+
+/**
+ * POSIX stand-in for the XMOS platform support.
+ *
+ * Selected by lf_platform.h when LF_HOST_STAND_IN is defined. It provides the
+ * same platform API as lf_xmos_support.h on top of pthreads and pipes so that
+ * the runtime extensions in this directory can be tested and benchmarked on
+ * a Linux or macOS host. Timing results on the host are only indicative.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+#include <pthread.h>
+
+typedef int64_t _instant_t;
+
+/**
+ * Interval of time.
+ */
+typedef int64_t _interval_t;
+
+/**
+ * Microstep instant.
+ */
+typedef uint32_t _microstep_t;
+
+#define LF_TIME_BUFFER_LENGTH 80
+#define _LF_TIMEOUT -2
+
+#include <inttypes.h>  // Needed to define PRId64 and PRIu32
+#define PRINTF_TIME "%" PRId64
+#define PRINTF_MICROSTEP "%" PRIu32
+#define PRINTF_TAG "(%" PRId64 ", %" PRIu32 ")"
+#define _LF_CLOCK CLOCK_MONOTONIC
+
+// The XMOS code asserts with xassert.
+#ifndef xassert
+#define xassert(e) assert(e)
+#endif
+
+#define _LF_MEMORY_BARRIER() __sync_synchronize()
+
+#ifdef NUMBER_OF_WORKERS
+#define NUMBER_OF_THREADS NUMBER_OF_WORKERS+1
+
+typedef pthread_t _lf_thread_t;
+
+// Recursive, like the XMOS mutex.
+typedef pthread_mutex_t _lf_mutex_t;
+
+typedef pthread_cond_t _lf_cond_t;
+
+// Sense-reversing barrier. Waiting threads block on a condition variable.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    int parties;
+    volatile int remaining;
+    volatile int sense;
+    unsigned wakeups;
+} _lf_barrier_t;
+
+typedef struct {
+    int count;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} _lf_semaphore_t;
+
+#define lf_bool_compare_and_swap(ptr, oldval, newval) __sync_bool_compare_and_swap(ptr, oldval, newval)
+#define lf_val_compare_and_swap(ptr, oldval, newval) __sync_val_compare_and_swap(ptr, oldval, newval)
+#define lf_atomic_fetch_add(ptr, value) __sync_fetch_and_add(ptr, value)
+#define lf_atomic_add_fetch(ptr, value) __sync_add_and_fetch(ptr, value)
+
+#endif
@@ -0,0 +1,99 @@
+#include "lf_parallel_for.h"
+#include "lf_platform.h"
+
+#ifndef NUMBER_OF_WORKERS
+#define NUMBER_OF_WORKERS 1
+#endif // NUMBER_OF_WORKERS
+
+extern lf_mutex_t mutex;
+
+typedef struct {
+    size_t begin;
+    size_t end;
+    size_t grain;
+    lf_parallel_for_body_t body;
+    void* arg;
+    // Next chunk to claim and number of chunks.
+    int next;
+    int chunks;
+    // Number of idle workers currently executing chunks.
+    int helpers;
+    bool active;
+} _lf_parallel_for_job_t;
+
+static _lf_parallel_for_job_t _lf_parallel_for_job;
+static void (*_lf_parallel_for_wake)(void) = NULL;
+static lf_cond_t _lf_parallel_for_helpers_done;
+
+/**
+ * Claim and execute chunks until none are left.
+ */
+static void _lf_parallel_for_run(_lf_parallel_for_job_t* job) {
+    int chunk;
+    while ((chunk = lf_atomic_fetch_add(&job->next, 1)) < job->chunks) {
+        size_t begin = job->begin + (size_t) chunk * job->grain;
+        size_t end = begin + job->grain < job->end ? begin + job->grain : job->end;
+        job->body(begin, end, job->arg);
+    }
+}
+
+void lf_parallel_for_init(void (*wake)(void)) {
+    lf_cond_init(&_lf_parallel_for_helpers_done);
+    _lf_parallel_for_wake = wake;
+}
+
+void lf_parallel_for(size_t begin, size_t end, size_t grain, lf_parallel_for_body_t body, void* arg) {
+    if (end <= begin) {
+        return;
+    }
+    if (grain == 0) {
+        grain = (end - begin + 4 * NUMBER_OF_WORKERS - 1) / (4 * NUMBER_OF_WORKERS);
+    }
+    if (_lf_parallel_for_wake == NULL || end - begin <= grain) {
+        body(begin, end, arg);
+        return;
+    }
+    _lf_parallel_for_job_t* job = &_lf_parallel_for_job;
+    lf_mutex_lock(&mutex);
+    if (job->active) {
+        // Only one parallel loop at a time.
+        lf_mutex_unlock(&mutex);
+        body(begin, end, arg);
+        return;
+    }
+    job->begin = begin;
+    job->end = end;
+    job->grain = grain;
+    job->body = body;
+    job->arg = arg;
+    job->next = 0;
+    job->chunks = (int) ((end - begin + grain - 1) / grain);
+    job->helpers = 0;
+    job->active = true;
+    _lf_parallel_for_wake();
+    lf_mutex_unlock(&mutex);
+
+    _lf_parallel_for_run(job);
+
+    lf_mutex_lock(&mutex);
+    while (job->helpers > 0) {
+        lf_cond_wait(&_lf_parallel_for_helpers_done, &mutex);
+    }
+    job->active = false;
+    lf_mutex_unlock(&mutex);
+}
+
+bool lf_parallel_for_help(void) {
+    _lf_parallel_for_job_t* job = &_lf_parallel_for_job;
+    if (!job->active || job->next >= job->chunks) {
+        return false;
+    }
+    job->helpers++;
+    lf_mutex_unlock(&mutex);
+    _lf_parallel_for_run(job);
+    lf_mutex_lock(&mutex);
+    if (--job->helpers == 0) {
+        lf_cond_signal(&_lf_parallel_for_helpers_done);
+    }
+    return true;
+}
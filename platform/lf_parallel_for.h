@@ -0,0 +1,44 @@
+#pragma once
+
+/**
+ * Data-parallel loops inside a reaction body.
+ *
+ * lf_parallel_for() splits an index range into chunks and executes them on
+ * the calling worker and on workers that are idle at the current level. It
+ * returns once every chunk is done. No threads are created: schedulers that
+ * support it register a wake-up function with lf_parallel_for_init() and
+ * call lf_parallel_for_help() from their idle loop. With other schedulers, or
+ * while another parallel loop is running, the range is executed by the
+ * calling worker alone.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Body of a parallel loop, invoked for indices 'begin' up to (excluding) 'end'.
+ */
+typedef void (*lf_parallel_for_body_t)(size_t begin, size_t end, void* arg);
+
+/**
+ * Invoke 'body' for all indices from 'begin' up to (excluding) 'end' in chunks
+ * of 'grain' indices, in parallel on idle workers. If 'grain' is 0, the range
+ * is split into four chunks per worker. Must not be called with the mutex held.
+ */
+void lf_parallel_for(size_t begin, size_t end, size_t grain, lf_parallel_for_body_t body, void* arg);
+
+/**
+ * Enable parallel loops. 'wake' is invoked with the mutex held when a loop
+ * starts and has to get idle workers to call lf_parallel_for_help().
+ * Called by schedulers in lf_sched_init().
+ */
+void lf_parallel_for_init(void (*wake)(void));
+
+/**
+ * Execute chunks of the running parallel loop, if any.
+ * Called by idle workers with the mutex held. The mutex is released while
+ * executing chunks.
+ * @return true if the worker helped, in which case the state of the scheduler
+ *  may have changed.
+ */
+bool lf_parallel_for_help(void);
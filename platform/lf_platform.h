@@ -42,7 +42,10 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef PLATFORM_H
 #define PLATFORM_H
 
-#if defined(ARDUINO)
+#if defined(LF_HOST_STAND_IN)
+    // POSIX stand-in for the XMOS support, used to test on a host
+    #include "platform/lf_host_support.h"
+#elif defined(ARDUINO)
     #include "platform/lf_arduino_support.h"
 #elif defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
    // Windows platforms
@@ -79,6 +82,29 @@ extern lf_mutex_t mutex;
 
 typedef _lf_cond_t lf_cond_t;            // Type to hold handle to a condition variable
 typedef _lf_thread_t lf_thread_t;        // Type to hold handle to a thread
+typedef _lf_barrier_t lf_barrier_t;      // Type to hold handle to a barrier
+typedef _lf_semaphore_t lf_semaphore_t;  // Type to hold handle to a semaphore
+
+#ifndef LF_THREAD_CONTEXT_CACHES
+#define LF_THREAD_CONTEXT_CACHES 4
+#endif
+
+// Slots of lf_thread_context_t.caches used by the runtime.
+#define LF_THREAD_CONTEXT_TOKENS 0   // Token cache of a worker, see reactor_common.c.
+
+/**
+ * State that belongs to one thread. Hot paths can keep worker-local caches
+ * here instead of in shared state.
+ */
+typedef struct {
+    // Worker number of the thread, or -1 if it is not a worker.
+    int worker_number;
+    // Number of lf_mutex_lock() calls of the thread without a matching
+    // lf_mutex_unlock(), including recursive ones.
+    int locks_held;
+    // Worker-local caches, such as free lists. Each user owns one slot.
+    void* caches[LF_THREAD_CONTEXT_CACHES];
+} lf_thread_context_t;
 #endif
 
 /**
@@ -210,9 +236,130 @@ extern int lf_cond_wait(lf_cond_t* cond, lf_mutex_t* mutex);
  */
 extern int lf_cond_timedwait(lf_cond_t* cond, lf_mutex_t* mutex, instant_t absolute_time_ns);
 
+/**
+ * Return the context of the calling thread. It is reset when the thread
+ * starts and only used by that thread.
+ */
+extern lf_thread_context_t* lf_thread_context();
+
+/**
+ * Initialize a sense-reversing barrier for 'parties' threads.
+ * A barrier synchronizes its parties in phases without taking the mutex.
+ * Each party calls lf_barrier_arrive(). The last one to arrive can prepare
+ * the next phase on its own and then calls lf_barrier_release(). The other
+ * parties call lf_barrier_wait() until it returns true:
+ *
+ *     int sense;
+ *     if (lf_barrier_arrive(&barrier, &sense)) {
+ *         ...
+ *         lf_barrier_release(&barrier);
+ *     } else {
+ *         while (!lf_barrier_wait(&barrier, sense)) { ... }
+ *     }
+ *
+ * @return 0 on success, platform-specific error number otherwise.
+ */
+extern int lf_barrier_init(lf_barrier_t* barrier, int parties);
 
+/**
+ * Free the resources of a barrier.
+ */
+extern void lf_barrier_free(lf_barrier_t* barrier);
+
+/**
+ * Arrive at the barrier and store the sense of the current phase in 'sense'.
+ *
+ * @return true if the caller is the last party to arrive. It must then call
+ *  lf_barrier_release() instead of lf_barrier_wait().
+ */
+extern bool lf_barrier_arrive(lf_barrier_t* barrier, int* sense);
+
+/**
+ * Start the next phase and wake the parties waiting for the current one.
+ */
+extern void lf_barrier_release(lf_barrier_t* barrier);
+
+/**
+ * Block until the phase with the given 'sense' is released or
+ * lf_barrier_wake() is called.
+ *
+ * @return true if the phase was released, false if the caller was woken
+ *  early and has to wait again.
+ */
+extern bool lf_barrier_wait(lf_barrier_t* barrier, int sense);
+
+/**
+ * Wake the waiting parties without releasing the phase.
+ */
+extern void lf_barrier_wake(lf_barrier_t* barrier);
+
+/**
+ * Create a counting semaphore with 'count' permits.
+ * Replaces core/utils/semaphore.c, see semaphore.h in this directory.
+ *
+ * @return The semaphore or NULL if it could not be created.
+ */
+extern lf_semaphore_t* lf_semaphore_new(int count);
+
+/**
+ * Add 'i' permits and wake up to 'i' threads waiting for one.
+ */
+extern void lf_semaphore_release(lf_semaphore_t* semaphore, int i);
+
+/**
+ * Take a permit, blocking until one is available.
+ */
+extern void lf_semaphore_acquire(lf_semaphore_t* semaphore);
+
+/**
+ * Block until no permits are left.
+ */
+extern void lf_semaphore_wait(lf_semaphore_t* semaphore);
+
+/**
+ * Free a semaphore created with lf_semaphore_new().
+ */
+extern void lf_semaphore_destroy(lf_semaphore_t* semaphore);
+
+
+#endif
+
+// Annotation of pointers to reaction functions, if the platform needs one.
+#ifndef LF_REACTION_FPTRGROUP
+#define LF_REACTION_FPTRGROUP
 #endif
 
+/**
+ * Sequence lock for data that is written by one thread at a time and read by
+ * any thread without locking. The sequence is odd while a write is under way,
+ * and a reader retries if it changed while reading.
+ */
+typedef struct {
+    volatile unsigned sequence;
+} lf_seqlock_t;
+
+static inline void lf_seqlock_write_begin(lf_seqlock_t* lock) {
+    lock->sequence++;
+    _LF_MEMORY_BARRIER();
+}
+
+static inline void lf_seqlock_write_end(lf_seqlock_t* lock) {
+    _LF_MEMORY_BARRIER();
+    lock->sequence++;
+}
+
+static inline unsigned lf_seqlock_read_begin(lf_seqlock_t* lock) {
+    unsigned sequence;
+    while ((sequence = lock->sequence) & 1u);
+    _LF_MEMORY_BARRIER();
+    return sequence;
+}
+
+static inline bool lf_seqlock_read_retry(lf_seqlock_t* lock, unsigned sequence) {
+    _LF_MEMORY_BARRIER();
+    return lock->sequence != sequence;
+}
+
 /**
  * Initialize the LF clock. Must be called before using other clock-related APIs.
  */
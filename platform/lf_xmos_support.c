@@ -19,24 +19,27 @@ static hwtimer_t lf_timer;
 static int32_t time_hi = 0;
 static uint32_t last_time = 0;
 
-// FIXME: Return the number specified by the user
+#define XMOS_MAX_NUMBER_OF_THREADS 8
+
+/**
+ * Return the number of hardware threads available for workers. The main
+ * thread occupies one of them.
+ */
 int lf_available_cores() {
-    return 1;
+    return XMOS_MAX_NUMBER_OF_THREADS - 1;
 }
 // Thread stack
 // FIXME: How big should it be?
 
 #ifdef NUMBER_OF_WORKERS
-#define XMOS_MAX_NUMBER_OF_THREADS 8
 #define STACK_WORDS_PER_THREAD 256
 #define STACK_BYTES_PER_WORD 4
 
-static int get_tid() {
+// The id of a hardware thread is a register. It is checked against the
+// thread table once when the thread starts, see thread_function().
+static inline int get_tid() {
     int result;
-    asm ("get r11, id" ::);
-    asm ("mov %0, r11" :"=r"(result):);
-
-    xassert(result < NUMBER_OF_THREADS);
+    asm volatile ("get r11, id\n\tmov %0, r11" : "=r"(result) : : "r11");
     return result;
 }
 
@@ -54,6 +57,25 @@ typedef struct {
 static thread_info_t thread_info[NUMBER_OF_THREADS];
 
 static lock_t atomics_lock;
+
+// Context of every hardware thread, indexed by thread id.
+static lf_thread_context_t thread_context[XMOS_MAX_NUMBER_OF_THREADS];
+
+static void reset_thread_context(lf_thread_context_t* context) {
+    context->worker_number = -1;
+    context->locks_held = 0;
+    for (int i = 0; i < LF_THREAD_CONTEXT_CACHES; i++) {
+        context->caches[i] = NULL;
+    }
+}
+
+// Chanend on which each hardware thread blocks in lf_semaphore_acquire() and
+// lf_semaphore_wait().
+static chanend_t wakeup_chan[NUMBER_OF_THREADS];
+#else
+// Protects the event queue in the unthreaded runtime, where helper threads
+// (lf_helpers.h) can call lf_schedule() while the main thread advances time.
+static lock_t critical_section_lock;
 #endif
 
 void lf_initialize_clock(void) {
@@ -62,6 +84,16 @@ void lf_initialize_clock(void) {
     //FIXME: This does not belong here really :(
     #ifdef NUMBER_OF_WORKERS
         atomics_lock = lock_alloc();
+        for (int i = 0; i<XMOS_MAX_NUMBER_OF_THREADS; i++) {
+            reset_thread_context(&thread_context[i]);
+        }
+        for (int i = 0; i<NUMBER_OF_THREADS; i++) {
+            wakeup_chan[i] = chanend_alloc();
+            xassert(wakeup_chan[i]);
+        }
+    #else
+        critical_section_lock = lock_alloc();
+        xassert(critical_section_lock != 0);
     #endif
 }
 
@@ -103,23 +135,40 @@ int lf_sleep_until(instant_t wakeup_time) {
     return 0;
 }
 
+#ifdef NUMBER_OF_WORKERS
+// With threads, lf_schedule() protects the event queue with the global
+// mutex. It is recursive, so this also works from within the runtime.
+int lf_critical_section_enter() {
+    return lf_mutex_lock(&mutex);
+}
+
+int lf_critical_section_exit() {
+    return lf_mutex_unlock(&mutex);
+}
+
+int lf_notify_of_event() {
+    return lf_cond_broadcast(&event_q_changed);
+}
+#else
+// The unthreaded runtime never enters the critical section recursively, so a
+// plain hardware lock is enough.
 int lf_critical_section_enter() {
-    xassert(false);
-    interrupt_mask_all();
+    lock_acquire(critical_section_lock);
     return 0;
 }
 
 int lf_critical_section_exit() {
-    xassert(false);
-    interrupt_unmask_all();
+    lock_release(critical_section_lock);
     return 0;
 }
 
 //FIXME: This is how physical actions can enter the LF system from external threads
+// The main thread sleeps on the hardware timer and does not look at new
+// events before the sleep ends.
 int lf_notify_of_event() {
-    xassert(false);
     return 0;
 }
+#endif
 
 #ifdef NUMBER_OF_WORKERS
 // Return first available thread info. 
@@ -157,6 +206,9 @@ typedef struct {
 
 void thread_function(void * args) {
     function_and_arg_t *func_and_arg = (function_and_arg_t *) args;
+    xassert(get_tid() < NUMBER_OF_THREADS);
+    // Hardware threads are reused, so clear what the last thread left.
+    reset_thread_context(&thread_context[get_tid()]);
     func_and_arg->func(func_and_arg->args);
 }
 
@@ -209,6 +261,14 @@ int lf_thread_join(lf_thread_t thread, void** thread_return) {
     return 0;
 }
 
+/**
+ * Return the context of the calling thread, an entry of a table indexed by
+ * the hardware thread id.
+ */
+lf_thread_context_t* lf_thread_context() {
+    return &thread_context[get_tid()];
+}
+
 /** 
  * Initialize a conditional variable.
  * 
@@ -339,7 +399,7 @@ int lf_cond_timedwait(lf_cond_t* cond, lf_mutex_t* mutex, instant_t absolute_tim
     xassert(t);
 
     // FIXME: Check for overflows
-    hwtimer_set_trigger_time(t, (uint32_t) absolute_time_ns/10);
+    hwtimer_set_trigger_time(t, (uint32_t) (absolute_time_ns/10));
 
     bool timeout = false;
     SELECT_RES(
@@ -358,6 +418,7 @@ int lf_cond_timedwait(lf_cond_t* cond, lf_mutex_t* mutex, instant_t absolute_tim
         break;
     }
     }
+    hwtimer_free(t);
     
     lf_mutex_lock(mutex);
     
@@ -370,41 +431,143 @@ int lf_cond_timedwait(lf_cond_t* cond, lf_mutex_t* mutex, instant_t absolute_tim
     }
 }
 
+// Number of mutexes in use with a hardware lock and with a bakery lock.
+// Mutexes are initialized and freed by one thread at a time.
+static int mutex_hardware_count = 0;
+static int mutex_software_count = 0;
+// Number of mutexes other than the global one with a hardware lock.
+static int mutex_hardware_others = 0;
+
+static bool is_global_mutex(lf_mutex_t* m) {
+    return m == &mutex;
+}
+
 /**
  * Initialize a mutex.
+ * The global mutex always gets a hardware lock. Up to LF_MUTEX_HARDWARE_LOCKS
+ * other mutexes get one while there are any left, the others a bakery lock.
  * 
  * @return 0 on success, platform-specific error number otherwise.
  */
  
 int lf_mutex_init(lf_mutex_t* mutex) {
     xassert(mutex);
-    lock_t lock = lock_alloc();
-    if(lock) {
-        mutex->lock = lock;
-        mutex->owner = -1;
-        mutex->level = 0;
-        return 0;   
-    } else {
+    bool global = is_global_mutex(mutex);
+    mutex->lock = 0;
+    if (global || mutex_hardware_others < LF_MUTEX_HARDWARE_LOCKS) {
+        mutex->lock = lock_alloc();
+    }
+    if (mutex->lock) {
+        mutex_hardware_count++;
+        if (!global) {
+            mutex_hardware_others++;
+        }
+    } else if (global) {
         return -1;
+    } else {
+        for (int i = 0; i<NUMBER_OF_THREADS; i++) {
+            mutex->choosing[i] = false;
+            mutex->ticket[i] = 0;
+        }
+        mutex_software_count++;
+    }
+    mutex->owner = -1;
+    mutex->level = 0;
+#ifdef LF_MUTEX_STATS
+    mutex->acquisitions = 0;
+    mutex->contended = 0;
+    mutex->wait_ticks = 0;
+    mutex->hold_ticks = 0;
+#endif
+    return 0;
+}
+
+#ifdef LF_MUTEX_STATS
+void lf_xmos_mutex_stats(lf_mutex_t* mutex, lf_xmos_mutex_stats_t* stats) {
+    xassert(mutex && stats);
+    stats->acquisitions = mutex->acquisitions;
+    stats->contended = mutex->contended;
+    // The reference clock ticks every 10 ns.
+    stats->wait_time = mutex->wait_ticks * 10;
+    stats->hold_time = mutex->hold_ticks * 10;
+}
+#endif
+
+void lf_xmos_mutex_free(lf_mutex_t* mutex) {
+    xassert(mutex && mutex->owner == -1);
+    if (mutex->lock) {
+        lock_free(mutex->lock);
+        mutex_hardware_count--;
+        if (!is_global_mutex(mutex)) {
+            mutex_hardware_others--;
+        }
+    } else {
+        mutex_software_count--;
+    }
+}
+
+void lf_xmos_mutex_usage(int* hardware, int* software) {
+    *hardware = mutex_hardware_count;
+    *software = mutex_software_count;
+}
+
+// Lamport's bakery lock. It only needs loads and stores to be seen in program
+// order, which holds for the threads of a tile.
+static void bakery_lock(lf_mutex_t* mutex, int tid) {
+    mutex->choosing[tid] = true;
+    unsigned max = 0;
+    for (int i = 0; i<NUMBER_OF_THREADS; i++) {
+        if (mutex->ticket[i] > max) {
+            max = mutex->ticket[i];
+        }
+    }
+    unsigned ticket = max + 1;
+    mutex->ticket[tid] = ticket;
+    mutex->choosing[tid] = false;
+    for (int i = 0; i<NUMBER_OF_THREADS; i++) {
+        if (i == tid) {
+            continue;
+        }
+        while (mutex->choosing[i]);
+        unsigned other;
+        while ((other = mutex->ticket[i]) != 0 && (other < ticket || (other == ticket && i < tid)));
     }
 }
 
 /**
  * Lock a mutex. Support resursive mutex
+ * While another thread holds a hardware lock, spin up to LF_MUTEX_SPIN_LIMIT
+ * times on the owner before blocking.
  * 
  * @return 0 on success, platform-specific error number otherwise.
  */
 int lf_mutex_lock(lf_mutex_t* mutex) {
     xassert(mutex);
     int tid = get_tid();
-    xassert(tid >= 0);
+    thread_context[tid].locks_held++;
 
     if (tid == mutex->owner) {
         mutex->level++;
     } else {
-        lock_acquire(mutex->lock);
+#ifdef LF_MUTEX_STATS
+        uint32_t arrived = hwtimer_get_time(lf_timer);
+        bool contended = mutex->owner != -1;
+#endif
+        if (mutex->lock) {
+            for (int i = 0; i < LF_MUTEX_SPIN_LIMIT && mutex->owner != -1; i++);
+            lock_acquire(mutex->lock);
+        } else {
+            bakery_lock(mutex, tid);
+        }
         mutex->owner = tid;
         mutex->level = 1;
+#ifdef LF_MUTEX_STATS
+        uint32_t now = hwtimer_get_time(lf_timer);
+        mutex->acquisitions++;
+        mutex->contended += contended;
+        mutex->wait_ticks += now - arrived;
+        mutex->acquired_at = now;
+#endif
     }
 
     return 0;
@@ -417,15 +580,191 @@ int lf_mutex_lock(lf_mutex_t* mutex) {
  */
 int lf_mutex_unlock(lf_mutex_t* mutex) {
     xassert(mutex);
+    // Only the owner may unlock, like the error-checking pthread mutex.
+    if (mutex->owner != get_tid()) {
+        xassert(0 && "lf_mutex_unlock() of a mutex the thread does not hold");
+        return -1;
+    }
+    thread_context[mutex->owner].locks_held--;
     mutex->level--;
     if (mutex->level == 0) {
+#ifdef LF_MUTEX_STATS
+        mutex->hold_ticks += hwtimer_get_time(lf_timer) - mutex->acquired_at;
+#endif
+        int tid = mutex->owner;
         mutex->owner = -1;
-        lock_release(mutex->lock);
+        if (mutex->lock) {
+            lock_release(mutex->lock);
+        } else {
+            mutex->ticket[tid] = 0;
+        }
     }
 
     return 0;
 }
 
+int lf_barrier_init(lf_barrier_t* barrier, int parties) {
+    xassert(barrier);
+    xassert(parties > 0 && parties <= NUMBER_OF_THREADS);
+    barrier->parties = parties;
+    barrier->remaining = parties;
+    barrier->sense = 0;
+    for (int i = 0; i<NUMBER_OF_THREADS; i++) {
+        barrier->waiting[i] = false;
+        barrier->chan[i] = chanend_alloc();
+        if (!barrier->chan[i]) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void lf_barrier_free(lf_barrier_t* barrier) {
+    xassert(barrier);
+    for (int i = 0; i<NUMBER_OF_THREADS; i++) {
+        chanend_free(barrier->chan[i]);
+    }
+}
+
+bool lf_barrier_arrive(lf_barrier_t* barrier, int* sense) {
+    xassert(barrier && sense);
+    // The sense only changes once every party has arrived, so it can be
+    // read before arriving.
+    *sense = barrier->sense;
+    return lf_atomic_add_fetch(&barrier->remaining, -1) == 0;
+}
+
+// Send an END token to every waiting thread. The flag of a waiting thread is
+// cleared by whoever sends it the token, so that it gets exactly one.
+static void barrier_notify(lf_barrier_t* barrier) {
+    chanend_t from = barrier->chan[get_tid()];
+    for (int i = 0; i<NUMBER_OF_THREADS; i++) {
+        if (barrier->waiting[i] && lf_bool_compare_and_swap(&barrier->waiting[i], true, false)) {
+            chanend_set_dest(from, barrier->chan[i]);
+            chanend_out_end_token(from);
+        }
+    }
+}
+
+void lf_barrier_release(lf_barrier_t* barrier) {
+    xassert(barrier);
+    barrier->remaining = barrier->parties;
+    barrier->sense = !barrier->sense;
+    barrier_notify(barrier);
+}
+
+bool lf_barrier_wait(lf_barrier_t* barrier, int sense) {
+    xassert(barrier);
+    int tid = get_tid();
+    barrier->waiting[tid] = true;
+    if (barrier->sense != sense) {
+        // Released before we got to block. If a token is on its way anyway,
+        // take it so that it does not end the next wait early.
+        if (!lf_bool_compare_and_swap(&barrier->waiting[tid], true, false)) {
+            chanend_check_end_token(barrier->chan[tid]);
+        }
+        return true;
+    }
+    chanend_check_end_token(barrier->chan[tid]);
+    return barrier->sense != sense;
+}
+
+void lf_barrier_wake(lf_barrier_t* barrier) {
+    xassert(barrier);
+    barrier_notify(barrier);
+}
+
+lf_semaphore_t* lf_semaphore_new(int count) {
+    lf_semaphore_t* semaphore = (lf_semaphore_t*) malloc(sizeof(lf_semaphore_t));
+    if (semaphore == NULL) {
+        return NULL;
+    }
+    semaphore->count = count;
+    semaphore->head = 0;
+    semaphore->number_waiting = 0;
+    for (int i = 0; i<NUMBER_OF_THREADS; i++) {
+        semaphore->waiting_for_zero[i] = false;
+    }
+    semaphore->chan = chanend_alloc();
+    if (!semaphore->chan) {
+        free(semaphore);
+        return NULL;
+    }
+    return semaphore;
+}
+
+// Wake up thread 'tid'. The atomics lock must be held, which also keeps other
+// threads from using the semaphore's chanend at the same time.
+static void semaphore_wake(lf_semaphore_t* semaphore, int tid) {
+    chanend_set_dest(semaphore->chan, wakeup_chan[tid]);
+    chanend_out_end_token(semaphore->chan);
+}
+
+static void semaphore_wake_zero_waiters(lf_semaphore_t* semaphore) {
+    for (int i = 0; i<NUMBER_OF_THREADS; i++) {
+        if (semaphore->waiting_for_zero[i]) {
+            semaphore->waiting_for_zero[i] = false;
+            semaphore_wake(semaphore, i);
+        }
+    }
+}
+
+void lf_semaphore_release(lf_semaphore_t* semaphore, int i) {
+    xassert(semaphore && i >= 0);
+    lock_acquire(atomics_lock);
+    semaphore->count += i;
+    // Hand permits over to waiting threads directly.
+    while (semaphore->count > 0 && semaphore->number_waiting > 0) {
+        int tid = semaphore->waiting[semaphore->head];
+        semaphore->head = (semaphore->head + 1) % NUMBER_OF_THREADS;
+        semaphore->number_waiting--;
+        semaphore->count--;
+        semaphore_wake(semaphore, tid);
+    }
+    if (semaphore->count == 0) {
+        semaphore_wake_zero_waiters(semaphore);
+    }
+    lock_release(atomics_lock);
+}
+
+void lf_semaphore_acquire(lf_semaphore_t* semaphore) {
+    xassert(semaphore);
+    int tid = get_tid();
+    lock_acquire(atomics_lock);
+    if (semaphore->count > 0) {
+        semaphore->count--;
+        if (semaphore->count == 0) {
+            semaphore_wake_zero_waiters(semaphore);
+        }
+        lock_release(atomics_lock);
+        return;
+    }
+    int tail = (semaphore->head + semaphore->number_waiting) % NUMBER_OF_THREADS;
+    semaphore->waiting[tail] = tid;
+    semaphore->number_waiting++;
+    lock_release(atomics_lock);
+    // The permit comes with the token.
+    chanend_check_end_token(wakeup_chan[tid]);
+}
+
+void lf_semaphore_wait(lf_semaphore_t* semaphore) {
+    xassert(semaphore);
+    int tid = get_tid();
+    lock_acquire(atomics_lock);
+    if (semaphore->count == 0) {
+        lock_release(atomics_lock);
+        return;
+    }
+    semaphore->waiting_for_zero[tid] = true;
+    lock_release(atomics_lock);
+    chanend_check_end_token(wakeup_chan[tid]);
+}
+
+void lf_semaphore_destroy(lf_semaphore_t* semaphore) {
+    xassert(semaphore);
+    chanend_free(semaphore->chan);
+    free(semaphore);
+}
 
 bool lf_xmos_bool_compare_and_swap(bool *ptr, bool oldval, bool newval) {
     bool res =  false;
@@ -439,12 +778,11 @@ bool lf_xmos_bool_compare_and_swap(bool *ptr, bool oldval, bool newval) {
 }
 
 int lf_xmos_val_compare_and_swap(int *ptr, int oldval, int newval) {
-    bool res = false;
     lock_acquire(atomics_lock);
-    if (*ptr  == oldval) {
+    int res = *ptr;
+    if (res == oldval) {
         *ptr = newval;
-        res = true;
-    } 
+    }
     lock_release(atomics_lock);
     return res;
 }
@@ -466,4 +804,4 @@ int lf_xmos_atomic_add_fetch(int *ptr, int val) {
 }
 
 
-#endif
\ No newline at end of file
+#endif
\ No newline at end of file
@@ -47,17 +47,62 @@ typedef uint32_t _microstep_t;
 // The underlying physical clock for Linux
 #define _LF_CLOCK CLOCK_MONOTONIC
 
+// Reaction bodies and deadline handlers are called through pointers, which
+// xcc cannot follow to inline the calls or to bound the stack of a thread.
+// With LF_DIRECT_DISPATCH, the build script puts the generated reaction
+// functions in the fptrgroup "lf_reactions", and the runtime calls them
+// through pointers of that group.
+#ifdef LF_DIRECT_DISPATCH
+#define LF_REACTION_FPTRGROUP __attribute__((fptrgroup("lf_reactions")))
+#endif
+
+// Threads of a tile issue their instructions in order against one memory, so
+// only the compiler has to be kept from reordering accesses.
+#define _LF_MEMORY_BARRIER() __asm__ volatile("" ::: "memory")
+
 #ifdef NUMBER_OF_WORKERS
 // FIXME: We shouldnt need more threads than specified workers...
-#define NUMBER_OF_THREADS NUMBER_OF_WORKERS+1
+#ifdef LF_BACKGROUND_THREADS
+// Threads of the background job pool, see lf_background.h.
+#define _LF_BACKGROUND_THREADS LF_BACKGROUND_THREADS
+#else
+#define _LF_BACKGROUND_THREADS 0
+#endif
+#define NUMBER_OF_THREADS (NUMBER_OF_WORKERS+1+_LF_BACKGROUND_THREADS)
 
 typedef xthread_t _lf_thread_t;        // Type to hold handle to a thread
 
+// A tile only has 4 hardware locks. Mutexes beyond LF_MUTEX_HARDWARE_LOCKS
+// (default 1) besides the global mutex use a bakery lock in memory instead.
+#ifndef LF_MUTEX_HARDWARE_LOCKS
+#define LF_MUTEX_HARDWARE_LOCKS 1
+#endif
+
+// Number of times lf_mutex_lock() checks whether the owner of a hardware lock
+// has released it before blocking (default 0). A blocked thread resumes as
+// soon as the lock is released, and a spinning thread takes issue slots from
+// the owner, so only raise this if LF_MUTEX_STATS shows short hold times.
+#ifndef LF_MUTEX_SPIN_LIMIT
+#define LF_MUTEX_SPIN_LIMIT 0
+#endif
+
 // Add owner and level to support recursive mutex
 typedef struct {
+    // Hardware lock, or 0 if the bakery lock is used.
     lock_t lock;
-    int owner;
+    // Bakery lock, indexed by hardware thread id.
+    volatile bool choosing[NUMBER_OF_THREADS];
+    volatile unsigned ticket[NUMBER_OF_THREADS];
+    volatile int owner;
     int level;
+#ifdef LF_MUTEX_STATS
+    // Updated while holding the mutex. Times are in reference clock ticks.
+    int acquisitions;
+    int contended;
+    uint64_t wait_ticks;
+    uint64_t hold_ticks;
+    uint32_t acquired_at;
+#endif
 } _lf_mutex_t;
 
 
@@ -72,6 +117,30 @@ typedef struct {
     chanend_t signal_chan;
 } _lf_cond_t;            // Type to hold handle to a condition variable
 
+// Sense-reversing barrier. Waiting threads block on their own chanend,
+// indexed by hardware thread id, until they are sent an END token.
+typedef struct {
+    int parties;
+    volatile int remaining;
+    volatile int sense;
+    volatile bool waiting[NUMBER_OF_THREADS];
+    chanend_t chan[NUMBER_OF_THREADS];
+} _lf_barrier_t;
+
+// Counting semaphore. Threads that have to wait queue up by hardware thread
+// id and block on the wake-up chanend of their thread. The semaphore's own
+// chanend sends them an END token.
+typedef struct {
+    int count;
+    // Threads waiting for a permit, in FIFO order.
+    int waiting[NUMBER_OF_THREADS];
+    int head;
+    int number_waiting;
+    // Threads waiting for the count to reach zero.
+    bool waiting_for_zero[NUMBER_OF_THREADS];
+    chanend_t chan;
+} _lf_semaphore_t;
+
 // FIXME: This mapping of atomics to a SINGLE lock is probably very inefficent
 //  but I dont see another way without chaning reactor_threaded.c
 
@@ -117,4 +186,31 @@ int lf_xmos_atomic_fetch_add(int *ptr, int val);
 int lf_xmos_atomic_add_fetch(int *ptr, int val);
 #define lf_atomic_add_fetch(ptr, value) lf_xmos_atomic_add_fetch((int *) ptr, value)
 
+/*
+ * Release the lock of a mutex that is not used anymore.
+ */
+void lf_xmos_mutex_free(_lf_mutex_t* mutex);
+
+/*
+ * Report the number of mutexes in use with a hardware lock and with a bakery lock.
+ */
+void lf_xmos_mutex_usage(int* hardware, int* software);
+
+#ifdef LF_MUTEX_STATS
+typedef struct {
+    // Number of times the mutex was locked, not counting recursive locks.
+    int acquisitions;
+    // Number of those in which another thread held the mutex.
+    int contended;
+    // Total time spent waiting for and holding the mutex, in nanoseconds.
+    int64_t wait_time;
+    int64_t hold_time;
+} lf_xmos_mutex_stats_t;
+
+/*
+ * Read the statistics of a mutex. Only available with LF_MUTEX_STATS.
+ */
+void lf_xmos_mutex_stats(_lf_mutex_t* mutex, lf_xmos_mutex_stats_t* stats);
+#endif
+
 #endif
\ No newline at end of file
@@ -34,6 +34,7 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "reactor_common.c"
 #include "lf_platform.h"
+#include "platform/lf_helpers.h"
 #include <signal.h> // To trap ctrl-c and invoke termination().
 //#include <assert.h>
 
@@ -60,18 +61,30 @@ pqueue_t* reaction_q;
  */
 void _lf_set_present(lf_port_base_t* port) {
 	bool* is_present_field = &port->is_present;
+#ifdef LF_HELPER_THREADS
+    // Reactions on helper threads can set ports concurrently.
+    int ipfas = lf_helpers_fetch_add(&_lf_is_present_fields_abbreviated_size, 1);
+    if (ipfas < _lf_is_present_fields_size) {
+        _lf_is_present_fields_abbreviated[ipfas] = is_present_field;
+    }
+#else
     if (_lf_is_present_fields_abbreviated_size < _lf_is_present_fields_size) {
         _lf_is_present_fields_abbreviated[_lf_is_present_fields_abbreviated_size]
             = is_present_field;
     }
     _lf_is_present_fields_abbreviated_size++;
+#endif
     *is_present_field = true;
 
     // Support for sparse destination multiports.
     if(port->sparse_record
     		&& port->destination_channel >= 0
 			&& port->sparse_record->size >= 0) {
+#ifdef LF_HELPER_THREADS
+    	int next = lf_helpers_fetch_add(&port->sparse_record->size, 1);
+#else
     	size_t next = port->sparse_record->size++;
+#endif
     	if (next >= port->sparse_record->capacity) {
     		// Buffer is full. Have to revert to the classic iteration.
     		port->sparse_record->size = -1;
@@ -148,8 +161,82 @@ void _lf_trigger_reaction(reaction_t* reaction, int worker_number) {
     }
 }
 
+/**
+ * Check the deadline of 'reaction' and invoke either the reaction or its
+ * deadline violation handler.
+ *
+ * @return true if outputs of the reaction have to be scheduled.
+ */
+static bool _lf_run_reaction(reaction_t* reaction) {
+    LF_PRINT_LOG("Invoking reaction %s at elapsed logical tag " PRINTF_TAG ".",
+    		reaction->name,
+            current_tag.time - start_time, current_tag.microstep);
+
+    // FIXME: These comments look outdated. We may need to update them.
+    // If the reaction has a deadline, compare to current physical time
+    // and invoke the deadline violation reaction instead of the reaction function
+    // if a violation has occurred. Note that the violation reaction will be invoked
+    // at most once per logical time value. If the violation reaction triggers the
+    // same reaction at the current time value, even if at a future superdense time,
+    // then the reaction will be invoked and the violation reaction will not be invoked again.
+    if (reaction->deadline >= 0LL) {
+        // Get the current physical time.
+        instant_t physical_time = lf_time_physical();
+        // FIXME: These comments look outdated. We may need to update them.
+        // Check for deadline violation.
+        // There are currently two distinct deadline mechanisms:
+        // local deadlines are defined with the reaction;
+        // container deadlines are defined in the container.
+        // They can have different deadlines, so we have to check both.
+        // Handle the local deadline first.
+        if (reaction->deadline == 0 || physical_time > current_tag.time + reaction->deadline) {
+            LF_PRINT_LOG("Deadline violation. Invoking deadline handler.");
+            // Deadline violation has occurred.
+            // Invoke the local handler, if there is one.
+            LF_REACTION_FPTRGROUP reaction_function_t handler = reaction->deadline_violation_handler;
+            if (handler != NULL) {
+                (*handler)(reaction->self);
+                // If the reaction produced outputs, put the resulting
+                // triggered reactions into the queue.
+                return true;
+            }
+            return false;
+        }
+    }
+
+    // Invoke the reaction function.
+    _lf_invoke_reaction(reaction, 0);   // 0 indicates unthreaded.
+
+    // If the reaction produced outputs, put the resulting triggered
+    // reactions into the queue.
+    return true;
+}
+
+#ifdef LF_HELPER_THREADS
+/**
+ * A reaction handed to a helper thread.
+ */
+typedef struct {
+    reaction_t* reaction;
+    bool schedule_outputs;
+} _lf_helper_item_t;
+
+static _lf_helper_item_t _lf_helper_items[LF_HELPER_THREADS];
+
+static void _lf_helper_run(void* item) {
+    _lf_helper_item_t* helper_item = (_lf_helper_item_t*) item;
+    helper_item->schedule_outputs = _lf_run_reaction(helper_item->reaction);
+}
+#endif
+
 /**
  * Execute all the reactions in the reaction queue at the current tag.
+ *
+ * With LF_HELPER_THREADS, reactions that are queued at the same level as the
+ * next reaction do not depend on each other and are executed by the helpers
+ * while the main thread executes the next reaction. Their outputs are
+ * scheduled in queue order once all of them are done, as if they had been
+ * executed one after the other.
  * 
  * @return Returns 1 if the execution should continue and 0 if the execution
  *  should stop.
@@ -160,56 +247,42 @@ int _lf_do_step(void) {
         // lf_print_snapshot();
         reaction_t* reaction = (reaction_t*)pqueue_pop(reaction_q);
         reaction->status = running;
-        
-        LF_PRINT_LOG("Invoking reaction %s at elapsed logical tag " PRINTF_TAG ".",
-        		reaction->name,
-                current_tag.time - start_time, current_tag.microstep);
-
-        bool violation = false;
 
-        // FIXME: These comments look outdated. We may need to update them.
-        // If the reaction has a deadline, compare to current physical time
-        // and invoke the deadline violation reaction instead of the reaction function
-        // if a violation has occurred. Note that the violation reaction will be invoked
-        // at most once per logical time value. If the violation reaction triggers the
-        // same reaction at the current time value, even if at a future superdense time,
-        // then the reaction will be invoked and the violation reaction will not be invoked again.
-        if (reaction->deadline >= 0LL) {
-            // Get the current physical time.
-            instant_t physical_time = lf_time_physical();
-            // FIXME: These comments look outdated. We may need to update them.
-            // Check for deadline violation.
-            // There are currently two distinct deadline mechanisms:
-            // local deadlines are defined with the reaction;
-            // container deadlines are defined in the container.
-            // They can have different deadlines, so we have to check both.
-            // Handle the local deadline first.
-            if (reaction->deadline == 0 || physical_time > current_tag.time + reaction->deadline) {
-                LF_PRINT_LOG("Deadline violation. Invoking deadline handler.");
-                // Deadline violation has occurred.
-                violation = true;
-                // Invoke the local handler, if there is one.
-                reaction_function_t handler = reaction->deadline_violation_handler;
-                if (handler != NULL) {
-                    (*handler)(reaction->self);
-                    // If the reaction produced outputs, put the resulting
-                    // triggered reactions into the queue.
-                    schedule_output_reactions(reaction, 0);
-                }
-            }
+#ifdef LF_HELPER_THREADS
+        int helpers = 0;
+        reaction_t* peer;
+        while (helpers < LF_HELPER_THREADS
+                && (peer = (reaction_t*) pqueue_peek(reaction_q)) != NULL
+                && LEVEL(peer->index) == LEVEL(reaction->index)) {
+            pqueue_pop(reaction_q);
+            peer->status = running;
+            _lf_helper_items[helpers].reaction = peer;
+            lf_helpers_post(helpers, &_lf_helper_items[helpers]);
+            helpers++;
         }
-        
-        if (!violation) {
-            // Invoke the reaction function.
-            _lf_invoke_reaction(reaction, 0);   // 0 indicates unthreaded.
+#endif
+
+        bool schedule_outputs = _lf_run_reaction(reaction);
 
-            // If the reaction produced outputs, put the resulting triggered
-            // reactions into the queue.
+#ifdef LF_HELPER_THREADS
+        for (int i = 0; i < helpers; i++) {
+            lf_helpers_wait();
+        }
+#endif
+        if (schedule_outputs) {
             schedule_output_reactions(reaction, 0);
         }
         // There cannot be any subsequent events that trigger this reaction at the
         //  current tag, so it is safe to conclude that it is now inactive.
         reaction->status = inactive;
+#ifdef LF_HELPER_THREADS
+        for (int i = 0; i < helpers; i++) {
+            if (_lf_helper_items[i].schedule_outputs) {
+                schedule_output_reactions(_lf_helper_items[i].reaction, 0);
+            }
+            _lf_helper_items[i].reaction->status = inactive;
+        }
+#endif
     }
     
 #ifdef MODAL_REACTORS
@@ -316,7 +389,10 @@ void lf_request_stop() {
 	tag_t new_stop_tag;
 	new_stop_tag.time = current_tag.time;
 	new_stop_tag.microstep = current_tag.microstep + 1;
+	// Helper threads may request a stop at the same time.
+	lf_critical_section_enter();
 	_lf_set_stop_tag(new_stop_tag);
+	lf_critical_section_exit();
 }
 
 /**
@@ -373,7 +449,7 @@ int lf_reactor_c_main(int argc, const char* argv[]) {
         reaction_q = pqueue_init(INITIAL_REACT_QUEUE_SIZE, in_reverse_order, get_reaction_index,
                 get_reaction_position, set_reaction_position, reaction_matches, print_reaction);
                 
-        current_tag = (tag_t){.time = start_time, .microstep = 0u};
+        _lf_set_current_tag((tag_t){.time = start_time, .microstep = 0u});
         _lf_execution_started = true;
         _lf_trigger_startup_reactions();
         _lf_initialize_timers(); 
@@ -383,11 +459,19 @@ int lf_reactor_c_main(int argc, const char* argv[]) {
         if (lf_tag_compare(current_tag, stop_tag) >= 0) {
             _lf_trigger_shutdown_reactions();
         }
+#ifdef LF_HELPER_THREADS
+        if (lf_helpers_init(_lf_helper_run) != 0) {
+            lf_print_error_and_exit("Failed to start %d helper threads.", LF_HELPER_THREADS);
+        }
+#endif
         LF_PRINT_DEBUG("Running the program's main loop.");
         // Handle reactions triggered at time (T,m).
         if (_lf_do_step()) {
             while (next() != 0);
         }
+#ifdef LF_HELPER_THREADS
+        lf_helpers_free();
+#endif
         // pqueue_free(reaction_q); FIXME: This might be causing weird memory errors
         return 0;
     } else {
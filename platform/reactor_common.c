@@ -36,8 +36,14 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  *  @author{Alexander Schulz-Rosengarten <als@informatik.uni-kiel.de>}
  */
 
-#include "platform.h"
+#include "lf_platform.h"
 #include "reactor.h"
+#ifdef LF_HELPER_THREADS
+#include "platform/lf_helpers.h"
+#endif
+// The build script renames the definitions of lf_tag() and lf_time_logical()
+// in tag.c, which read current_tag without synchronization. They are defined
+// below with a read section of _lf_tag_seqlock instead, and tag.c calls these.
 #include "tag.c"
 #include "utils/pqueue.c"
 #include "utils/vector.c"
@@ -81,11 +87,56 @@ bool _lf_execution_started = false;
  * It will be initially set to timeout if it is set. However,
  * starvation or calling lf_request_stop() can also alter the stop_tag by moving it
  * earlier.
- * 
- * FIXME: This variable might need to be volatile
+ *
+ * It is written under _lf_tag_seqlock, like current_tag.
  */
 tag_t stop_tag = FOREVER_TAG_INITIALIZER;
 
+/**
+ * Sequence lock of current_tag and stop_tag. They are only written with the
+ * mutex held (or in a critical section without threads), so readers that
+ * only need a consistent tag do not have to take the mutex.
+ */
+lf_seqlock_t _lf_tag_seqlock = {0};
+
+/**
+ * Read current_tag and stop_tag without the mutex. Either may be NULL.
+ */
+static void _lf_read_tags(tag_t* current, tag_t* stop) {
+    unsigned sequence;
+    do {
+        sequence = lf_seqlock_read_begin(&_lf_tag_seqlock);
+        if (current != NULL) {
+            *current = current_tag;
+        }
+        if (stop != NULL) {
+            *stop = stop_tag;
+        }
+    } while (lf_seqlock_read_retry(&_lf_tag_seqlock, sequence));
+}
+
+tag_t lf_tag() {
+    tag_t tag;
+    _lf_read_tags(&tag, NULL);
+    return tag;
+}
+
+instant_t lf_time_logical(void) {
+    return lf_tag().time;
+}
+
+/**
+ * Set the current tag, e.g. at startup.
+ *
+ * @note In threaded programs, the mutex must be locked before
+ *  calling this function.
+ */
+void _lf_set_current_tag(tag_t tag) {
+    lf_seqlock_write_begin(&_lf_tag_seqlock);
+    current_tag = tag;
+    lf_seqlock_write_end(&_lf_tag_seqlock);
+}
+
 /** Indicator of whether the keepalive command-line option was given. */
 bool keepalive_specified = false;
 
@@ -273,7 +324,9 @@ void _lf_free_all_reactors(void) {
  */
 void _lf_set_stop_tag(tag_t tag) {
     if (lf_tag_compare(tag, stop_tag) < 0) {
+        lf_seqlock_write_begin(&_lf_tag_seqlock);
         stop_tag = tag;
+        lf_seqlock_write_end(&_lf_tag_seqlock);
     }
 }
 
@@ -344,6 +397,177 @@ int _lf_token_recycling_bin_size = 0;
  */
 #define _LF_TOKEN_RECYCLING_BIN_SIZE_LIMIT 512
 
+// With LF_HELPER_THREADS, reactions of one level run on several threads of
+// the unthreaded runtime and share the recycling bin and the counters.
+#ifdef LF_HELPER_THREADS
+#define _LF_TOKEN_BIN_LOCK() lf_helpers_lock()
+#define _LF_TOKEN_BIN_UNLOCK() lf_helpers_unlock()
+#else
+#define _LF_TOKEN_BIN_LOCK()
+#define _LF_TOKEN_BIN_UNLOCK()
+#endif
+
+#ifdef NUMBER_OF_WORKERS
+/**
+ * Number of tokens that workers move between their cache and the shared
+ * depot at once.
+ */
+#ifndef LF_TOKEN_MAGAZINE_SIZE
+#define LF_TOKEN_MAGAZINE_SIZE 16
+#endif
+
+/**
+ * Tokens recycled by a worker. Workers take tokens from and recycle tokens
+ * to their own cache without locking. A cache holds up to two magazines of
+ * LF_TOKEN_MAGAZINE_SIZE tokens. When it is full, one magazine moves to the
+ * shared depot, and when it is empty, it takes a magazine from there, so the
+ * depot lock is taken at most once every LF_TOKEN_MAGAZINE_SIZE tokens.
+ * Threads that are not workers use _lf_token_recycling_bin as before.
+ */
+typedef struct {
+    // Tokens chained by their next_free field.
+    lf_token_t* tokens;
+    int size;
+    // Allocations counted by this worker, see _lf_count_allocations().
+    int token_allocations;
+    int payload_allocations;
+} _lf_token_cache_t;
+
+// NUMBER_OF_WORKERS is 0 if the runtime picks the number of workers. Workers
+// beyond the caches use the recycling bin with the mutex.
+#define _LF_TOKEN_CACHES (NUMBER_OF_WORKERS > 0 ? NUMBER_OF_WORKERS : 1)
+static _lf_token_cache_t _lf_token_caches[_LF_TOKEN_CACHES];
+
+// Full magazines, each a chain of LF_TOKEN_MAGAZINE_SIZE tokens. Together with
+// the caches, they hold about as many tokens as the recycling bin.
+#define _LF_TOKEN_DEPOT_SIZE (_LF_TOKEN_RECYCLING_BIN_SIZE_LIMIT / LF_TOKEN_MAGAZINE_SIZE)
+static lf_token_t* _lf_token_depot[_LF_TOKEN_DEPOT_SIZE];
+static int _lf_token_depot_size = 0;
+static lf_mutex_t _lf_token_depot_lock;
+
+/**
+ * Initialize the token depot. Called once before the workers start.
+ */
+void _lf_token_caches_init() {
+    lf_mutex_init(&_lf_token_depot_lock);
+}
+
+/**
+ * Free the tokens left in the caches and the depot, and release the depot
+ * lock. Called once after the workers exited. The allocation counters of the
+ * caches are kept for termination().
+ */
+void _lf_token_caches_free() {
+    for (int i = 0; i < _LF_TOKEN_CACHES; i++) {
+        lf_token_t* token = _lf_token_caches[i].tokens;
+        while (token != NULL) {
+            lf_token_t* next = token->next_free;
+            free(token);
+            token = next;
+        }
+        _lf_token_caches[i].tokens = NULL;
+        _lf_token_caches[i].size = 0;
+    }
+    while (_lf_token_depot_size > 0) {
+        lf_token_t* token = _lf_token_depot[--_lf_token_depot_size];
+        while (token != NULL) {
+            lf_token_t* next = token->next_free;
+            free(token);
+            token = next;
+        }
+    }
+    lf_xmos_mutex_free(&_lf_token_depot_lock);
+}
+
+/**
+ * Make the calling thread use the token cache of the given worker.
+ */
+void _lf_token_cache_attach(int worker_number) {
+    if (worker_number < NUMBER_OF_WORKERS) {
+        lf_thread_context()->caches[LF_THREAD_CONTEXT_TOKENS] = &_lf_token_caches[worker_number];
+    }
+}
+
+/**
+ * Return the token cache of the calling thread, or NULL if it is not a worker.
+ */
+static inline _lf_token_cache_t* _lf_token_cache() {
+    return (_lf_token_cache_t*) lf_thread_context()->caches[LF_THREAD_CONTEXT_TOKENS];
+}
+
+/**
+ * Take a token from the cache, refilling it from the depot if it is empty.
+ * @return A recycled token, or NULL if there is none.
+ */
+static lf_token_t* _lf_token_cache_take(_lf_token_cache_t* cache) {
+    if (cache->tokens == NULL) {
+        lf_mutex_lock(&_lf_token_depot_lock);
+        if (_lf_token_depot_size > 0) {
+            cache->tokens = _lf_token_depot[--_lf_token_depot_size];
+            cache->size = LF_TOKEN_MAGAZINE_SIZE;
+        }
+        lf_mutex_unlock(&_lf_token_depot_lock);
+        if (cache->tokens == NULL) {
+            return NULL;
+        }
+    }
+    lf_token_t* token = cache->tokens;
+    cache->tokens = token->next_free;
+    cache->size--;
+    return token;
+}
+
+/**
+ * Put a token in the cache. If the cache is full, move a magazine to the
+ * depot first, or free its tokens if the depot is full too.
+ */
+static void _lf_token_cache_put(_lf_token_cache_t* cache, lf_token_t* token) {
+    if (cache->size == 2 * LF_TOKEN_MAGAZINE_SIZE) {
+        lf_token_t* magazine = cache->tokens;
+        lf_token_t* last = magazine;
+        for (int i = 1; i < LF_TOKEN_MAGAZINE_SIZE; i++) {
+            last = last->next_free;
+        }
+        cache->tokens = last->next_free;
+        cache->size -= LF_TOKEN_MAGAZINE_SIZE;
+        last->next_free = NULL;
+        lf_mutex_lock(&_lf_token_depot_lock);
+        if (_lf_token_depot_size < _LF_TOKEN_DEPOT_SIZE) {
+            _lf_token_depot[_lf_token_depot_size++] = magazine;
+            magazine = NULL;
+        }
+        lf_mutex_unlock(&_lf_token_depot_lock);
+        while (magazine != NULL) {
+            lf_token_t* next = magazine->next_free;
+            free(magazine);
+            magazine = next;
+        }
+    }
+    token->next_free = cache->tokens;
+    cache->tokens = token;
+    cache->size++;
+}
+#endif // NUMBER_OF_WORKERS
+
+/**
+ * Count allocated (positive) or freed (negative) tokens and payloads. Workers
+ * count in their token cache so that they do not need the mutex.
+ */
+static void _lf_count_allocations(int tokens, int payloads) {
+#ifdef NUMBER_OF_WORKERS
+    _lf_token_cache_t* cache = _lf_token_cache();
+    if (cache != NULL) {
+        cache->token_allocations += tokens;
+        cache->payload_allocations += payloads;
+        return;
+    }
+#endif
+    _LF_TOKEN_BIN_LOCK();
+    _lf_count_token_allocations += tokens;
+    _lf_count_payload_allocations += payloads;
+    _LF_TOKEN_BIN_UNLOCK();
+}
+
 /** Possible return values for _lf_done_using. */
 typedef enum token_freed {
     NOT_FREED,     // Nothing was freed.
@@ -369,7 +593,7 @@ token_freed _lf_free_token(lf_token_t* token) {
     if (token->value != NULL) {
         // Count frees to issue a warning if this is never freed.
         // Do not free the value field if it is garbage collected and token's ok_to_free field is not "token_and_value".
-        _lf_count_payload_allocations--;
+        _lf_count_allocations(0, -1);
         if (OK_TO_FREE != token_only && token->ok_to_free == token_and_value) {
             LF_PRINT_DEBUG("_lf_free_token: Freeing allocated memory for payload (token value): %p", token->value);
             if (token->destructor == NULL) {
@@ -386,22 +610,63 @@ token_freed _lf_free_token(lf_token_t* token) {
     // ports and should not be freed. They are expected to be reused instead.
     if (token->ok_to_free) {
         // Need to free the lf_token_t struct also.
-        if (_lf_token_recycling_bin_size < _LF_TOKEN_RECYCLING_BIN_SIZE_LIMIT) {
-            // Recycle instead of freeing.
-            token->next_free = _lf_token_recycling_bin;
-            _lf_token_recycling_bin = token;
-            _lf_token_recycling_bin_size++;
-        } else {
-            // Recycling bin is full.
-            free(token);
+#ifdef NUMBER_OF_WORKERS
+        _lf_token_cache_t* cache = _lf_token_cache();
+        if (cache != NULL) {
+            _lf_token_cache_put(cache, token);
+        } else
+#endif
+        {
+            _LF_TOKEN_BIN_LOCK();
+            bool recycled = _lf_token_recycling_bin_size < _LF_TOKEN_RECYCLING_BIN_SIZE_LIMIT;
+            if (recycled) {
+                // Recycle instead of freeing.
+                token->next_free = _lf_token_recycling_bin;
+                _lf_token_recycling_bin = token;
+                _lf_token_recycling_bin_size++;
+            }
+            _LF_TOKEN_BIN_UNLOCK();
+            if (!recycled) {
+                // Recycling bin is full.
+                free(token);
+            }
         }
-        _lf_count_token_allocations--;
+        _lf_count_allocations(-1, 0);
         LF_PRINT_DEBUG("_lf_free_token: Freeing allocated memory for token: %p", token);
         result = TOKEN_FREED;
     }
     return result;
 }
 
+/**
+ * Add a reference to a token. In the threaded runtime, workers pass tokens
+ * on and drop them without holding the mutex, so the reference count is
+ * updated atomically. The same holds for helper threads.
+ */
+static inline void _lf_token_ref(lf_token_t* token) {
+#ifdef NUMBER_OF_WORKERS
+    lf_atomic_fetch_add(&token->ref_count, 1);
+#elif defined(LF_HELPER_THREADS)
+    lf_helpers_fetch_add(&token->ref_count, 1);
+#else
+    token->ref_count++;
+#endif
+}
+
+/**
+ * Drop a reference to a token.
+ * @return The number of references left.
+ */
+static inline int _lf_token_unref(lf_token_t* token) {
+#ifdef NUMBER_OF_WORKERS
+    return lf_atomic_add_fetch(&token->ref_count, -1);
+#elif defined(LF_HELPER_THREADS)
+    return lf_helpers_fetch_add(&token->ref_count, -1) - 1;
+#else
+    return --token->ref_count;
+#endif
+}
+
 /**
  * Decrement the reference count of the specified token.
  * If the reference count hits 0, free the memory for the value
@@ -416,13 +681,15 @@ token_freed _lf_done_using(lf_token_t* token) {
     if (token == NULL) {
         return NOT_FREED;
     }
-    if (token->ref_count == 0) {
+    // Only the holder of the last reference sees 0 and frees the token.
+    int ref_count = _lf_token_unref(token);
+    if (ref_count < 0) {
+        _lf_token_ref(token);
         lf_print_warning("Token being freed that has already been freed: %p", token);
         return NOT_FREED;
     }
-    token->ref_count--;
-    LF_PRINT_DEBUG("_lf_done_using: ref_count = %d.", token->ref_count);
-    return token->ref_count == 0 ? _lf_free_token(token) : NOT_FREED;
+    LF_PRINT_DEBUG("_lf_done_using: ref_count = %d.", ref_count);
+    return ref_count == 0 ? _lf_free_token(token) : NOT_FREED;
 }
 
 /**
@@ -507,14 +774,27 @@ void _lf_start_time_step() {
  * @return A new or recycled lf_token_t struct.
  */
 lf_token_t* _lf_create_token(size_t element_size) {
-    lf_token_t* token;
-    // Check the recycling bin.
-    if (_lf_token_recycling_bin != NULL) {
-        token = _lf_token_recycling_bin;
-        _lf_token_recycling_bin = token->next_free;
-        _lf_token_recycling_bin_size--;
-        LF_PRINT_DEBUG("_lf_create_token: Retrieved token from the recycling bin: %p", token);
-    } else {
+    lf_token_t* token = NULL;
+#ifdef NUMBER_OF_WORKERS
+    _lf_token_cache_t* cache = _lf_token_cache();
+    if (cache != NULL) {
+        token = _lf_token_cache_take(cache);
+    } else
+#endif
+    {
+        // Check the recycling bin.
+        _LF_TOKEN_BIN_LOCK();
+        if (_lf_token_recycling_bin != NULL) {
+            token = _lf_token_recycling_bin;
+            _lf_token_recycling_bin = token->next_free;
+            _lf_token_recycling_bin_size--;
+        }
+        _LF_TOKEN_BIN_UNLOCK();
+        if (token != NULL) {
+            LF_PRINT_DEBUG("_lf_create_token: Retrieved token from the recycling bin: %p", token);
+        }
+    }
+    if (token == NULL) {
         token = (lf_token_t*)malloc(sizeof(lf_token_t));
         LF_PRINT_DEBUG("_lf_create_token: Allocated memory for token: %p", token);
     }
@@ -536,12 +816,14 @@ lf_token_t* _lf_create_token(size_t element_size) {
  *  0 if there is no payload.
  * @return A new or recycled lf_token_t struct.
  * 
- * @note For multithreaded applications, the caller must hold
- *  the mutex lock because it accesses global variables.
+ * @note For multithreaded applications, a caller that is not a worker
+ *  must hold the mutex lock because it accesses global variables.
+ *  Workers use their own token cache. Helper threads (LF_HELPER_THREADS)
+ *  share the recycling bin under lf_helpers_lock().
  */
 lf_token_t* create_token(size_t element_size) {
     LF_PRINT_DEBUG("create_token: element_size: %zu", element_size);
-    _lf_count_token_allocations++;
+    _lf_count_allocations(1, 0);
     lf_token_t* result = _lf_create_token(element_size);
     result->ok_to_free = OK_TO_FREE;
     return result;
@@ -597,7 +879,7 @@ lf_token_t* _lf_initialize_token(lf_token_t* token, size_t length) {
     // Allocate memory for storing the array.
     void* value = malloc(token->element_size * length);
     // Count allocations to issue a warning if this is never freed.
-    _lf_count_payload_allocations++;
+    _lf_count_allocations(0, 1);
     return _lf_initialize_token_with_value(token, value, length);
 }
 
@@ -607,9 +889,14 @@ lf_token_t* _lf_initialize_token(lf_token_t* token, size_t length) {
  * @param tag The tag to check against stop tag
  */
 bool _lf_is_tag_after_stop_tag(tag_t tag) {
-    return (lf_tag_compare(tag, stop_tag) > 0);
+    tag_t stop;
+    _lf_read_tags(NULL, &stop);
+    return (lf_tag_compare(tag, stop) > 0);
 }
 
+static event_t* _lf_schedule_new_event(trigger_t* trigger, lf_token_t* token);
+static trigger_handle_t _lf_schedule_timer(trigger_t* trigger, interval_t delay, event_t* e);
+
 /**
  * Pop all events from event_q with timestamp equal to current_tag.time, extract all
  * the reactions triggered by these events, and stick them into the reaction
@@ -694,7 +981,8 @@ void _lf_pop_events() {
         // If the trigger is a periodic timer, create a new event for its next execution.
         if (event->trigger->is_timer && event->trigger->period > 0LL) {
             // Reschedule the trigger.
-            _lf_schedule(event->trigger, event->trigger->period, NULL);
+            _lf_schedule_timer(event->trigger, event->trigger->period,
+                    _lf_schedule_new_event(event->trigger, NULL));
         }
 
         // Copy the token pointer into the trigger struct so that the
@@ -706,7 +994,7 @@ void _lf_pop_events() {
             event->trigger->token->ok_to_free = OK_TO_FREE;
             // Free the token if its reference count is zero. Since _lf_done_using
             // decrements the reference count, first increment it here.
-            event->trigger->token->ref_count++;
+            _lf_token_ref(event->trigger->token);
             _lf_done_using(event->trigger->token);
         }
         event->trigger->token = token;
@@ -912,7 +1200,7 @@ int _lf_schedule_at_tag(trigger_t* trigger, tag_t tag, lf_token_t* token) {
 
     // Increment the reference count of the token.
     if (token != NULL) {
-        token->ref_count++;
+        _lf_token_ref(token);
     }
 
     // Do not schedule events if the tag is after the stop tag
@@ -1070,81 +1358,9 @@ int _lf_schedule_at_tag(trigger_t* trigger, tag_t tag, lf_token_t* token) {
 }
 
 /**
- * Schedule the specified trigger at current_tag.time plus the offset of the
- * specified trigger plus the delay. See schedule_token() in reactor.h for details.
- * This is the internal implementation shared by both the threaded
- * and non-threaded versions.
- *
- * The value is required to be either
- * NULL or a pointer to a token wrapping the payload. The token carries
- * a reference count, and when the reference count decrements to 0,
- * the will be freed. Hence, it is essential that the payload be in
- * memory allocated using malloc.
- *
- * There are three conditions under which this function will not
- * actually put an event on the event queue and decrement the reference count
- * of the token (if there is one), which could result in the payload being
- * freed. In all three cases, this function returns 0. Otherwise,
- * it returns a handle to the scheduled trigger, which is an integer
- * greater than 0.
- *
- * The first condition is that a stop has been requested and the trigger
- * offset plus the extra delay is greater than zero.
- * The second condition is that the trigger offset plus the extra delay
- * is greater that the requested stop time (timeout).
- * The third condition is that the trigger argument is null.
- *
- * @param trigger The trigger to be invoked at a later logical time.
- * @param extra_delay The logical time delay, which gets added to the
- *  trigger's minimum delay, if it has one. If this number is negative,
- *  then zero is used instead.
- * @param token The token wrapping the payload or NULL for no payload.
- * @return A handle to the event, or 0 if no new event was scheduled, or -1 for error.
+ * Get an event for the trigger that carries the given token.
  */
-trigger_handle_t _lf_schedule(trigger_t* trigger, interval_t extra_delay, lf_token_t* token) {
-    if (_lf_is_tag_after_stop_tag(current_tag)) {
-        // If schedule is called after stop_tag
-        // This is a critical condition.
-        _lf_done_using(token);
-        lf_print_warning("lf_schedule() called after stop tag.");
-        return 0;
-    }
-
-    if (extra_delay < 0LL) {
-        lf_print_warning("schedule called with a negative extra_delay " PRINTF_TIME ". Replacing with zero.", extra_delay);
-        extra_delay = 0LL;
-    }
-
-    LF_PRINT_DEBUG("_lf_schedule: scheduling trigger %p with delay " PRINTF_TIME " and token %p.",
-            trigger, extra_delay, token);
-    
-	// The trigger argument could be null, meaning that nothing is triggered.
-    // Doing this after incrementing the reference count ensures that the
-    // payload will be freed, if there is one.
-	if (trigger == NULL) {
-	    _lf_done_using(token);
-	    return 0;
-	}
-
-    // Increment the reference count of the token.
-	if (token != NULL) {
-	    token->ref_count++;
-	}
-
-    // Compute the tag (the logical timestamp for the future event).
-	// We first do this assuming it is logical action and then, if it is a
-	// physical action, modify it if physical time exceeds the result.
-    interval_t delay = extra_delay;
-    // Add the offset if this is not a timer because, in that case,
-    // it is the minimum delay.
-    if (!trigger->is_timer) {
-    	delay += trigger->offset;
-    }
-    interval_t intended_time = current_tag.time + delay;
-    LF_PRINT_DEBUG("_lf_schedule: current_tag.time = " PRINTF_TIME ". Total logical delay = " PRINTF_TIME "",
-            current_tag.time, delay);
-    interval_t min_spacing = trigger->period;
-
+static event_t* _lf_schedule_new_event(trigger_t* trigger, lf_token_t* token) {
     event_t* e = _lf_get_new_event();
     
     // Initialize the next pointer.
@@ -1157,65 +1373,181 @@ trigger_handle_t _lf_schedule(trigger_t* trigger, interval_t extra_delay, lf_tok
     // dequeued, it will trigger this trigger.
     e->trigger = trigger;
 
-    // If the trigger is physical, then we need to check whether
-    // physical time is larger than the intended time and, if so,
-    // modify the intended time.
-    if (trigger->is_physical) {
-        // Get the current physical time and assign it as the intended time.
-        intended_time = lf_time_physical() + delay;
-    } else {
-        // FIXME: We need to verify that we are executing within a reaction?
-        // See reactor_threaded.
-        // If a logical action is scheduled asynchronously (which should never be
-        // done) the computed tag can be smaller than the current tag, in which case
-        // it needs to be adjusted.
-        // FIXME: This can go away once:
-        // - we have eliminated the possibility to have a negative additional delay; and
-        // - we detect the asynchronous use of logical actions
-        if (intended_time < current_tag.time) {
-            lf_print_warning("Attempting to schedule an event earlier than current time by " PRINTF_TIME " nsec! "
-                    "Revising to the current time " PRINTF_TIME ".",
-                    current_tag.time - intended_time, current_tag.time);
-            intended_time = current_tag.time;
-        }
-    }
-
 #ifdef FEDERATED_DECENTRALIZED
     // Event inherits the original intended_tag of the trigger
     // set by the network stack (or the default, which is (NEVER,0))
     e->intended_tag = trigger->intended_tag;
 #endif
+    return e;
+}
+
+/**
+ * Put an event for the trigger on the event queue at the given time, unless
+ * that is past the stop time. This is the last step of all the
+ * _lf_schedule_*() routines below.
+ *
+ * @return A handle to the event, or 0 if it was discarded.
+ */
+static trigger_handle_t _lf_schedule_insert(trigger_t* trigger, event_t* e, instant_t intended_time) {
+    // Set the tag of the event.
+    e->time = intended_time;
+
+    // Do not schedule events if if the event time is past the stop time
+    // (current microsteps are checked earlier).
+    LF_PRINT_DEBUG("Comparing event with elapsed time " PRINTF_TIME " against stop time " PRINTF_TIME ".", e->time - start_time, stop_tag.time - start_time);
+    if (e->time > stop_tag.time) {
+        LF_PRINT_DEBUG("_lf_schedule: event time is past the timeout. Discarding event.");
+        _lf_done_using(e->token);
+        _lf_recycle_event(e);
+        return(0);
+    }
     
-    event_t* existing = (event_t*)(trigger->last);
-    // Check for conflicts (a queued event with the same trigger and time).
-    if (trigger->period < 0) {
-        // No minimum spacing defined.
-        tag_t intended_tag = (tag_t) {.time = intended_time, .microstep = 0u};
-        e->time = intended_tag.time;
-        event_t* found = (event_t *)pqueue_find_equal_same_priority(event_q, e);
-        // Check for conflicts. Let events pile up in super dense time.
-        if (found != NULL) {
-            intended_tag.microstep++;
-            // Skip to the last node in the linked list.
-            while(found->next != NULL) {
-                found = found->next;
-                intended_tag.microstep++;
-            }
-            if (_lf_is_tag_after_stop_tag(intended_tag)) {
-                LF_PRINT_DEBUG("Attempt to schedule an event after stop_tag was rejected.");
-                // Scheduling an event will incur a microstep
-                // after the stop tag.
-                _lf_recycle_event(e);
-                return 0;
-            }
-            // Hook the event into the list.
-            found->next = e;
-            return(0); // FIXME: return value
-        }
+    // Store a pointer to the current event in order to check the min spacing
+    // between this and the following event. Only necessary for actions
+    // that actually specify a min spacing.
+    trigger->last = (event_t*)e;
+
+    // Queue the event.
+    // NOTE: There is no need for an explicit microstep because
+    // when this is called, all events at the current tag
+    // (time and microstep) have been pulled from the queue,
+    // and any new events added at this tag will go into the reaction_q
+    // rather than the event_q, so anything put in the event_q with this
+    // same time will automatically be executed at the next microstep.
+    LF_PRINT_LOG("Inserting event in the event queue with elapsed time " PRINTF_TIME ".",
+            e->time - start_time);
+    pqueue_insert(event_q, e);
+
+    tracepoint_schedule(trigger, e->time - current_tag.time);
+
+    // FIXME: make a record of handle and implement unschedule.
+    // NOTE: Rather than wrapping around to get a negative number,
+    // we reset the handle on the assumption that much earlier
+    // handles are irrelevant.
+    int return_value = _lf_handle++;
+    if (_lf_handle < 0) {
+        _lf_handle = 1;
+    }
+    return return_value;
+}
+
+/**
+ * Return the given time, or the current time if it is earlier.
+ * A physical action can compute a time before the current tag when logical
+ * time is ahead of physical time.
+ */
+static instant_t _lf_schedule_not_before_current(instant_t intended_time) {
+    // FIXME: This is a development assertion and might
+    // not be necessary for end-user LF programs
+    if (intended_time < current_tag.time) {
+        lf_print_error("Attempting to schedule an event earlier than current time by " PRINTF_TIME " nsec! "
+                "Revising to the current time " PRINTF_TIME ".",
+                current_tag.time - intended_time, current_tag.time);
+        intended_time = current_tag.time;
+    }
+    return intended_time;
+}
+
+/**
+ * Return the time of a logical action scheduled with the given delay.
+ */
+static instant_t _lf_schedule_logical_time(interval_t delay) {
+    interval_t intended_time = current_tag.time + delay;
+    // FIXME: We need to verify that we are executing within a reaction?
+    // See reactor_threaded.
+    // If a logical action is scheduled asynchronously (which should never be
+    // done) the computed tag can be smaller than the current tag, in which case
+    // it needs to be adjusted.
+    // FIXME: This can go away once:
+    // - we have eliminated the possibility to have a negative additional delay; and
+    // - we detect the asynchronous use of logical actions
+    if (intended_time < current_tag.time) {
+        lf_print_warning("Attempting to schedule an event earlier than current time by " PRINTF_TIME " nsec! "
+                "Revising to the current time " PRINTF_TIME ".",
+                current_tag.time - intended_time, current_tag.time);
+        intended_time = current_tag.time;
+    }
+    return intended_time;
+}
+
+/**
+ * Append the event to an event of an action without minimum spacing that is
+ * queued at the same time, so that they pile up in superdense time.
+ *
+ * @return True if there was such an event, in which case the new event is
+ *  either appended or recycled, or false if the new event still has to be
+ *  inserted.
+ */
+static bool _lf_schedule_pile_up(event_t* e, instant_t intended_time) {
+    tag_t intended_tag = (tag_t) {.time = intended_time, .microstep = 0u};
+    e->time = intended_tag.time;
+    event_t* found = (event_t *)pqueue_find_equal_same_priority(event_q, e);
+    if (found == NULL) {
         // If there are not conflicts, schedule as usual. If intended time is
-        // equal to the current logical time, the event will effectively be 
+        // equal to the current logical time, the event will effectively be
         // scheduled at the next microstep.
-    } else if (!trigger->is_timer && existing != NULL) { 
+        return false;
+    }
+    intended_tag.microstep++;
+    // Skip to the last node in the linked list.
+    while(found->next != NULL) {
+        found = found->next;
+        intended_tag.microstep++;
+    }
+    if (_lf_is_tag_after_stop_tag(intended_tag)) {
+        LF_PRINT_DEBUG("Attempt to schedule an event after stop_tag was rejected.");
+        // Scheduling an event will incur a microstep
+        // after the stop tag.
+        _lf_recycle_event(e);
+        return true;
+    }
+    // Hook the event into the list.
+    found->next = e;
+    return true;
+}
+
+/**
+ * Schedule the next event of a timer. The offset of a timer is its initial
+ * delay, which has already passed, and events of a timer never collide.
+ */
+static trigger_handle_t _lf_schedule_timer(trigger_t* trigger, interval_t delay, event_t* e) {
+    return _lf_schedule_insert(trigger, e, current_tag.time + delay);
+}
+
+/**
+ * Schedule a logical action without minimum spacing.
+ */
+static trigger_handle_t _lf_schedule_logical(trigger_t* trigger, interval_t delay, event_t* e) {
+    instant_t intended_time = _lf_schedule_logical_time(trigger->offset + delay);
+    if (_lf_schedule_pile_up(e, intended_time)) {
+        return(0); // FIXME: return value
+    }
+    return _lf_schedule_insert(trigger, e, intended_time);
+}
+
+/**
+ * Schedule a physical action without minimum spacing.
+ */
+static trigger_handle_t _lf_schedule_physical(trigger_t* trigger, interval_t delay, event_t* e) {
+    instant_t intended_time = lf_time_physical() + trigger->offset + delay;
+    if (_lf_schedule_pile_up(e, intended_time)) {
+        return(0); // FIXME: return value
+    }
+    return _lf_schedule_insert(trigger, e, _lf_schedule_not_before_current(intended_time));
+}
+
+/**
+ * Schedule a logical or physical action with a minimum spacing, applying its
+ * policy if the previous event is too close.
+ */
+static trigger_handle_t _lf_schedule_spaced(trigger_t* trigger, interval_t delay, event_t* e) {
+    delay += trigger->offset;
+    instant_t intended_time = trigger->is_physical
+            ? lf_time_physical() + delay : _lf_schedule_logical_time(delay);
+    interval_t min_spacing = trigger->period;
+    lf_token_t* token = e->token;
+    event_t* existing = (event_t*)(trigger->last);
+    if (existing != NULL) { 
         // There exists a previously scheduled event. It determines the
         // earliest time at which the new event can be scheduled.
         // Check to see whether the event is too early. 
@@ -1283,58 +1615,84 @@ trigger_handle_t _lf_schedule(trigger_t* trigger, interval_t extra_delay, lf_tok
             }
         }
     }
+    return _lf_schedule_insert(trigger, e, _lf_schedule_not_before_current(intended_time));
+}
 
-    // Check if the intended time is in the future
-    // This is a sanity check for the logic above
-    // FIXME: This is a development assertion and might
-    // not be necessary for end-user LF programs
-    if (intended_time < current_tag.time) {
-        lf_print_error("Attempting to schedule an event earlier than current time by " PRINTF_TIME " nsec! "
-                "Revising to the current time " PRINTF_TIME ".",
-                current_tag.time - intended_time, current_tag.time);
-        intended_time = current_tag.time;
+/**
+ * Schedule the specified trigger at current_tag.time plus the offset of the
+ * specified trigger plus the delay. See schedule_token() in reactor.h for details.
+ * This is the internal implementation shared by both the threaded
+ * and non-threaded versions.
+ *
+ * The value is required to be either
+ * NULL or a pointer to a token wrapping the payload. The token carries
+ * a reference count, and when the reference count decrements to 0,
+ * the will be freed. Hence, it is essential that the payload be in
+ * memory allocated using malloc.
+ *
+ * There are three conditions under which this function will not
+ * actually put an event on the event queue and decrement the reference count
+ * of the token (if there is one), which could result in the payload being
+ * freed. In all three cases, this function returns 0. Otherwise,
+ * it returns a handle to the scheduled trigger, which is an integer
+ * greater than 0.
+ *
+ * The first condition is that a stop has been requested and the trigger
+ * offset plus the extra delay is greater than zero.
+ * The second condition is that the trigger offset plus the extra delay
+ * is greater that the requested stop time (timeout).
+ * The third condition is that the trigger argument is null.
+ *
+ * After these checks, the event is handed to the _lf_schedule_*() routine
+ * for the kind of trigger, which only does the checks that apply to it.
+ *
+ * @param trigger The trigger to be invoked at a later logical time.
+ * @param extra_delay The logical time delay, which gets added to the
+ *  trigger's minimum delay, if it has one. If this number is negative,
+ *  then zero is used instead.
+ * @param token The token wrapping the payload or NULL for no payload.
+ * @return A handle to the event, or 0 if no new event was scheduled, or -1 for error.
+ */
+trigger_handle_t _lf_schedule(trigger_t* trigger, interval_t extra_delay, lf_token_t* token) {
+    if (_lf_is_tag_after_stop_tag(current_tag)) {
+        // If schedule is called after stop_tag
+        // This is a critical condition.
+        _lf_done_using(token);
+        lf_print_warning("lf_schedule() called after stop tag.");
+        return 0;
     }
 
-    // Set the tag of the event.
-    e->time = intended_time;
-
-    // Do not schedule events if if the event time is past the stop time
-    // (current microsteps are checked earlier).
-    LF_PRINT_DEBUG("Comparing event with elapsed time " PRINTF_TIME " against stop time " PRINTF_TIME ".", e->time - start_time, stop_tag.time - start_time);
-    if (e->time > stop_tag.time) {
-        LF_PRINT_DEBUG("_lf_schedule: event time is past the timeout. Discarding event.");
-        _lf_done_using(token);
-        _lf_recycle_event(e);
-        return(0);
+    if (extra_delay < 0LL) {
+        lf_print_warning("schedule called with a negative extra_delay " PRINTF_TIME ". Replacing with zero.", extra_delay);
+        extra_delay = 0LL;
     }
-    
-    // Store a pointer to the current event in order to check the min spacing
-    // between this and the following event. Only necessary for actions
-    // that actually specify a min spacing.
-    trigger->last = (event_t*)e;
 
-    // Queue the event.
-    // NOTE: There is no need for an explicit microstep because
-    // when this is called, all events at the current tag
-    // (time and microstep) have been pulled from the queue,
-    // and any new events added at this tag will go into the reaction_q
-    // rather than the event_q, so anything put in the event_q with this
-    // same time will automatically be executed at the next microstep.
-    LF_PRINT_LOG("Inserting event in the event queue with elapsed time " PRINTF_TIME ".",
-            e->time - start_time);
-    pqueue_insert(event_q, e);
+    LF_PRINT_DEBUG("_lf_schedule: scheduling trigger %p with delay " PRINTF_TIME " and token %p.",
+            trigger, extra_delay, token);
+    
+	// The trigger argument could be null, meaning that nothing is triggered.
+    // Doing this after incrementing the reference count ensures that the
+    // payload will be freed, if there is one.
+	if (trigger == NULL) {
+	    _lf_done_using(token);
+	    return 0;
+	}
 
-    tracepoint_schedule(trigger, e->time - current_tag.time);
+    // Increment the reference count of the token.
+	if (token != NULL) {
+	    _lf_token_ref(token);
+	}
 
-    // FIXME: make a record of handle and implement unschedule.
-    // NOTE: Rather than wrapping around to get a negative number,
-    // we reset the handle on the assumption that much earlier
-    // handles are irrelevant.
-    int return_value = _lf_handle++;
-    if (_lf_handle < 0) {
-        _lf_handle = 1;
+    event_t* e = _lf_schedule_new_event(trigger, token);
+    if (trigger->is_timer) {
+        return _lf_schedule_timer(trigger, extra_delay, e);
+    } else if (trigger->period >= 0) {
+        return _lf_schedule_spaced(trigger, extra_delay, e);
+    } else if (trigger->is_physical) {
+        return _lf_schedule_physical(trigger, extra_delay, e);
+    } else {
+        return _lf_schedule_logical(trigger, extra_delay, e);
     }
-    return return_value;
 }
 
 /**
@@ -1372,7 +1730,7 @@ trigger_handle_t _lf_insert_reactions_for_trigger(trigger_t* trigger, lf_token_t
 
     // Increment the reference count of the token.
 	if (token != NULL) {
-	    token->ref_count++;
+	    _lf_token_ref(token);
 	}
 
     // Check if the trigger has violated the STP offset
@@ -1403,7 +1761,7 @@ trigger_handle_t _lf_insert_reactions_for_trigger(trigger_t* trigger, lf_token_t
         trigger->token->ok_to_free = OK_TO_FREE;
         // Free the token if its reference count is zero. Since _lf_done_using
         // decrements the reference count, first increment it here.
-        trigger->token->ref_count++;
+        _lf_token_ref(trigger->token);
         _lf_done_using(trigger->token);
     }
     trigger->token = token;
@@ -1543,10 +1901,9 @@ void _lf_advance_logical_time(instant_t next_time) {
     }
 
     if (current_tag.time < next_time) {
-        current_tag.time = next_time;
-        current_tag.microstep = 0;
+        _lf_set_current_tag((tag_t) {.time = next_time, .microstep = 0});
     } else if (current_tag.time == next_time) {
-        current_tag.microstep++;
+        _lf_set_current_tag((tag_t) {.time = next_time, .microstep = current_tag.microstep + 1});
     } else {
         lf_print_error_and_exit("_lf_advance_logical_time(): Attempted to move tag back in time.");
     }
@@ -1610,7 +1967,8 @@ bool _lf_check_deadline(self_base_t* self, bool invoke_deadline_handler) {
     reaction_t* reaction = self->executing_reaction;
     if (lf_time_physical() > lf_time_logical() + reaction->deadline) {
         if (invoke_deadline_handler) {
-            reaction->deadline_violation_handler(self);
+            LF_REACTION_FPTRGROUP reaction_function_t handler = reaction->deadline_violation_handler;
+            handler(self);
         }
         return true;
     }
@@ -1626,7 +1984,8 @@ bool _lf_check_deadline(self_base_t* self, bool invoke_deadline_handler) {
 void _lf_invoke_reaction(reaction_t* reaction, int worker) {
     tracepoint_reaction_starts(reaction, worker);
     ((self_base_t*) reaction->self)->executing_reaction = reaction;
-    reaction->function(reaction->self);
+    LF_REACTION_FPTRGROUP reaction_function_t function = reaction->function;
+    function(reaction->self);
     ((self_base_t*) reaction->self)->executing_reaction = NULL;
     tracepoint_reaction_ends(reaction, worker);
 }
@@ -1736,7 +2095,7 @@ void schedule_output_reactions(reaction_t* reaction, int worker) {
         if (downstream_to_execute_now->is_STP_violated == true) {
             // Tardiness has occurred
             LF_PRINT_LOG("Event has STP violation.");
-            reaction_function_t handler = downstream_to_execute_now->STP_handler;
+            LF_REACTION_FPTRGROUP reaction_function_t handler = downstream_to_execute_now->STP_handler;
             // Invoke the STP handler if there is one.
             if (handler != NULL) {
                 // There is a violation and it is being handled here
@@ -1766,7 +2125,7 @@ void schedule_output_reactions(reaction_t* reaction, int worker) {
                 // Deadline violation has occurred.
                 violation = true;
                 // Invoke the local handler, if there is one.
-                reaction_function_t handler = downstream_to_execute_now->deadline_violation_handler;
+                LF_REACTION_FPTRGROUP reaction_function_t handler = downstream_to_execute_now->deadline_violation_handler;
                 if (handler != NULL) {
                     // Assume the mutex is still not held.
                     (*handler)(downstream_to_execute_now->self);
@@ -1831,7 +2190,7 @@ lf_token_t* writable_copy(lf_token_t* token) {
     }
     // Create a new, dynamically allocated token.
     lf_token_t* result = create_token(token->element_size);
-    _lf_count_payload_allocations++;
+    _lf_count_allocations(0, 1);
     result->length = token->length;
     result->value = copy;
     result->destructor = token->destructor;
@@ -2042,7 +2401,7 @@ void initialize(void) {
     _lf_initialize_trigger_objects();
 
     physical_start_time = lf_time_physical();
-    current_tag.time = physical_start_time;
+    _lf_set_current_tag((tag_t) {.time = physical_start_time, .microstep = current_tag.microstep});
     start_time = current_tag.time;
 
     #ifdef BIT_32
@@ -2101,6 +2460,12 @@ void termination(void) {
         lf_print_warning("---- The first future event has timestamp " PRINTF_TIME " after start time.", event_time);
     }
     // Issue a warning if a memory leak has been detected.
+#ifdef NUMBER_OF_WORKERS
+    for (int i = 0; i < _LF_TOKEN_CACHES; i++) {
+        _lf_count_token_allocations += _lf_token_caches[i].token_allocations;
+        _lf_count_payload_allocations += _lf_token_caches[i].payload_allocations;
+    }
+#endif
     if (_lf_count_payload_allocations > 0) {
         lf_print_warning("Memory allocated for messages has not been freed.");
         lf_print_warning("Number of unfreed messages: %d.", _lf_count_payload_allocations);
@@ -38,6 +38,7 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "../reactor_common.c"
 #include "../lf_platform.h"
 #include "scheduler.h"
+#include "../platform/lf_background.h"
 #include <signal.h>
 
 // The one and only mutex lock.
@@ -46,6 +47,22 @@ extern lf_mutex_t mutex;
 // Condition variables used for notification between threads.
 extern lf_cond_t event_q_changed;
 
+#if NUMBER_OF_WORKERS == 1
+// Only the single worker executes reactions, so the state that reactions
+// update needs no atomic operations. Asynchronous events still go through
+// the mutex.
+static inline int _lf_worker_fetch_add(int* ptr, int value) {
+    int old = *ptr;
+    *ptr = old + value;
+    return old;
+}
+#define _lf_worker_bool_compare_and_swap(ptr, oldval, newval) \
+        (*(ptr) == (oldval) ? (*(ptr) = (newval), true) : false)
+#else
+#define _lf_worker_fetch_add(ptr, value) lf_atomic_fetch_add(ptr, value)
+#define _lf_worker_bool_compare_and_swap(ptr, oldval, newval) lf_bool_compare_and_swap(ptr, oldval, newval)
+#endif
+
 /**
  * The maximum amount of time a worker thread should stall
  * before checking the reaction queue again.
@@ -303,7 +320,7 @@ int _lf_wait_on_global_tag_barrier(tag_t proposed_tag) {
  */
 void _lf_set_present(lf_port_base_t* port) {
 	bool* is_present_field = &port->is_present;
-    int ipfas = lf_atomic_fetch_add(&_lf_is_present_fields_abbreviated_size, 1);
+    int ipfas = _lf_worker_fetch_add(&_lf_is_present_fields_abbreviated_size, 1);
     if (ipfas < _lf_is_present_fields_size) {
         _lf_is_present_fields_abbreviated[ipfas] = is_present_field;
     }
@@ -313,7 +330,7 @@ void _lf_set_present(lf_port_base_t* port) {
     if(port->sparse_record
     		&& port->destination_channel >= 0
 			&& port->sparse_record->size >= 0) {
-    	int next = lf_atomic_fetch_add(&port->sparse_record->size, 1);
+    	int next = _lf_worker_fetch_add(&port->sparse_record->size, 1);
     	if (next >= port->sparse_record->capacity) {
     		// Buffer is full. Have to revert to the classic iteration.
     		port->sparse_record->size = -1;
@@ -338,6 +355,18 @@ void _lf_set_present(lf_port_base_t* port) {
  */
 void synchronize_with_other_federates();
 
+#ifdef LF_TAG_STATS
+/**
+ * Lateness of the first reaction of each tag with respect to the time of the
+ * tag. Reported when the program exits so that the jitter of the start of
+ * tags can be compared between configurations.
+ */
+bool _lf_tag_start_measured = true;
+int _lf_tag_starts = 0;
+interval_t _lf_tag_start_lateness_total = 0;
+interval_t _lf_tag_start_lateness_max = 0;
+#endif // LF_TAG_STATS
+
 /**
  * Wait until physical time matches or exceeds the specified logical time,
  * unless -fast is given.
@@ -509,6 +538,34 @@ tag_t send_next_event_tag(tag_t tag, bool wait_for_reply) {
 #endif
 }
 
+/**
+ * Wait until physical time matches or exceeds 'logical_time', like
+ * wait_until() on event_q_changed. A background job that finishes during
+ * the wait interrupts it. With -fast, wait_until() returns right away, so if
+ * the event queue is empty and background jobs are outstanding, this waits
+ * for an event instead of letting the tag run ahead to the stop tag.
+ *
+ * The mutex lock is assumed to be held by the calling thread.
+ */
+static bool _lf_wait_until_next_tag(instant_t logical_time) {
+#ifdef LF_BACKGROUND_THREADS
+    // A job that finishes after the first collection sees the announcement
+    // and notifies event_q_changed.
+    lf_background_sleeping_locked(true);
+    bool waited = lf_background_collect_locked() == 0;
+    if (waited && fast && pqueue_peek(event_q) == NULL && lf_background_outstanding() > 0) {
+        lf_cond_wait(&event_q_changed, &mutex);
+        waited = false;
+    } else if (waited) {
+        waited = wait_until(logical_time, &event_q_changed);
+    }
+    lf_background_sleeping_locked(false);
+    return lf_background_collect_locked() == 0 && waited;
+#else
+    return wait_until(logical_time, &event_q_changed);
+#endif
+}
+
 /**
  * If there is at least one event in the event queue, then wait until
  * physical time matches or exceeds the time of the least tag on the event
@@ -526,6 +583,14 @@ tag_t send_next_event_tag(tag_t tag, bool wait_for_reply) {
  * Every time tag is advanced, it is checked against stop tag and if they are
  * equal, shutdown reactions are triggered.
  *
+ * This is called by the worker that finds the current tag complete.
+ * FIXME: A dedicated timekeeper thread that owns event_q, the wait and
+ * _lf_pop_events() would keep workers out of time advancement. It is not
+ * implemented: every scheduler would need a way to receive the reactions of
+ * the next tag without a worker calling this. A timekeeper that only runs
+ * this on behalf of a waiting worker adds two hand-offs per tag and was
+ * removed.
+ *
  * This does not acquire the mutex lock. It assumes the lock is already held.
  */
 void _lf_next_locked() {
@@ -534,6 +599,11 @@ void _lf_next_locked() {
     _lf_handle_mode_changes();
 #endif
 
+#ifdef LF_BACKGROUND_THREADS
+    // Turn background jobs that finished into physical action events.
+    lf_background_collect_locked();
+#endif
+
     // Previous logical time is complete.
     tag_t next_tag = get_next_event_tag();
 
@@ -566,7 +636,12 @@ void _lf_next_locked() {
     // behavior with centralized coordination as with unfederated execution.
 
 #else  // not FEDERATED_CENTRALIZED
-    if (pqueue_peek(event_q) == NULL && !keepalive_specified) {
+    bool background_jobs = false;
+#ifdef LF_BACKGROUND_THREADS
+    // Outstanding background jobs will still schedule their actions.
+    background_jobs = lf_background_outstanding() > 0;
+#endif
+    if (pqueue_peek(event_q) == NULL && !keepalive_specified && !background_jobs) {
         // There is no event on the event queue and keepalive is false.
         // No event in the queue
         // keepalive is not set so we should stop.
@@ -579,24 +654,40 @@ void _lf_next_locked() {
     }
 #endif
 
-    // Wait for physical time to advance to the next event time (or stop time).
-    // This can be interrupted if a physical action triggers (e.g., a message
-    // arrives from an upstream federate or a local physical action triggers).
-    LF_PRINT_LOG("Waiting until elapsed time " PRINTF_TIME ".", (next_tag.time - start_time));
-    while (!wait_until(next_tag.time, &event_q_changed)) {
-        LF_PRINT_DEBUG("_lf_next_locked(): Wait until time interrupted.");
-        // Sleep was interrupted.  Check for a new next_event.
-        // The interruption could also have been due to a call to lf_request_stop().
-        next_tag = get_next_event_tag();
-
-        // If this (possibly new) next tag is past the stop time, return.
-        if (_lf_is_tag_after_stop_tag(next_tag)) {
-            return;
+#ifndef FEDERATED
+    // Fast path: with -fast, or if the next tag is only a microstep away,
+    // physical time never has to catch up, so the event queue cannot change
+    // while we hold the mutex. Skip reading the clock and the wait. This only
+    // applies if the next tag is that of an event before the stop tag. If the
+    // queue is empty, or the next tag is the stop tag, the wait is where
+    // keepalive programs and outstanding background jobs get new events.
+    // Each call still advances one tag: the reactions of a tag have to run,
+    // through the scheduler, before the next tag can start, so consecutive
+    // tags cannot be batched in here.
+    event_t* head = (event_t*) pqueue_peek(event_q);
+    bool next_is_event = head != NULL && head->time == next_tag.time && lf_tag_compare(next_tag, stop_tag) < 0;
+    if (!next_is_event || (!fast && next_tag.time != current_tag.time))
+#endif
+    {
+        // Wait for physical time to advance to the next event time (or stop time).
+        // This can be interrupted if a physical action triggers (e.g., a message
+        // arrives from an upstream federate or a local physical action triggers).
+        LF_PRINT_LOG("Waiting until elapsed time " PRINTF_TIME ".", (next_tag.time - start_time));
+        while (!_lf_wait_until_next_tag(next_tag.time)) {
+            LF_PRINT_DEBUG("_lf_next_locked(): Wait until time interrupted.");
+            // Sleep was interrupted.  Check for a new next_event.
+            // The interruption could also have been due to a call to lf_request_stop().
+            next_tag = get_next_event_tag();
+
+            // If this (possibly new) next tag is past the stop time, return.
+            if (_lf_is_tag_after_stop_tag(next_tag)) {
+                return;
+            }
         }
+        // A wait occurs even if wait_until() returns true, which means that the
+        // tag on the head of the event queue may have changed.
+        next_tag = get_next_event_tag();
     }
-    // A wait occurs even if wait_until() returns true, which means that the
-    // tag on the head of the event queue may have changed.
-    next_tag = get_next_event_tag();
 
     // If this (possibly new) next tag is past the stop time, return.
     if (_lf_is_tag_after_stop_tag(next_tag)) { // lf_tag_compare(tag, stop_tag) > 0
@@ -649,6 +740,12 @@ void _lf_next_locked() {
     // extract all the reactions triggered by these events, and
     // stick them into the reaction queue.
     _lf_pop_events();
+
+#ifdef LF_TAG_STATS
+    // The first worker to start a reaction at this tag records its lateness.
+    // Lateness is meaningless with -fast, so skip reading the clock.
+    _lf_tag_start_measured = fast;
+#endif
 }
 
 /**
@@ -660,11 +757,17 @@ void _lf_next_locked() {
  * all federates stop at the same logical time.
  */
 void lf_request_stop() {
-    lf_mutex_lock(&mutex);
     // Check if already at the previous stop tag.
-    if (lf_tag_compare(current_tag, stop_tag) >= 0) {
+    tag_t current, stop;
+    _lf_read_tags(&current, &stop);
+    if (lf_tag_compare(current, stop) >= 0) {
         // If so, ignore the stop request since the program
         // is already stopping at the current tag.
+        return;
+    }
+    lf_mutex_lock(&mutex);
+    // The tags may have changed before the mutex was acquired.
+    if (lf_tag_compare(current_tag, stop_tag) >= 0) {
         lf_mutex_unlock(&mutex);
         return;
     }
@@ -730,7 +833,7 @@ void _lf_initialize_start_tag() {
 
     // Get a start_time from the RTI
     synchronize_with_other_federates(); // Resets start_time in federated execution according to the RTI.
-    current_tag = (tag_t){.time = start_time, .microstep = 0u};
+    _lf_set_current_tag((tag_t){.time = start_time, .microstep = 0u});
 #endif
 
     _lf_initialize_timers();
@@ -800,6 +903,16 @@ void _lf_initialize_start_tag() {
 /** For logging and debugging, each worker thread is numbered. */
 int worker_thread_count = 0;
 
+#ifdef LF_DEADLINE_STATS
+/**
+ * Number of deadline checks performed and deadline violations detected.
+ * Reported when the program exits so that schedulers can be compared
+ * on their deadline-miss rate.
+ */
+int _lf_deadline_checks = 0;
+int _lf_deadline_misses = 0;
+#endif // LF_DEADLINE_STATS
+
 /**
  * Handle deadline violation for 'reaction'.
  * The mutex should NOT be locked when this function is called. It might acquire
@@ -819,12 +932,18 @@ bool _lf_worker_handle_deadline_violation_for_reaction(int worker_number, reacti
     if (reaction->deadline >= 0LL) {
         // Get the current physical time.
         instant_t physical_time = lf_time_physical();
+#ifdef LF_DEADLINE_STATS
+        _lf_worker_fetch_add(&_lf_deadline_checks, 1);
+#endif
         // Check for deadline violation.
         if (reaction->deadline == 0 || physical_time > current_tag.time + reaction->deadline) {
             // Deadline violation has occurred.
             violation_occurred = true;
+#ifdef LF_DEADLINE_STATS
+            _lf_worker_fetch_add(&_lf_deadline_misses, 1);
+#endif
             // Invoke the local handler, if there is one.
-            reaction_function_t handler = reaction->deadline_violation_handler;
+            LF_REACTION_FPTRGROUP reaction_function_t handler = reaction->deadline_violation_handler;
             if (handler != NULL) {
                 LF_PRINT_LOG("Worker %d: Deadline violation. Invoking deadline handler.",
                         worker_number);
@@ -867,7 +986,7 @@ bool _lf_worker_handle_STP_violation_for_reaction(int worker_number, reaction_t*
     // @note In absence of an STP handler, the is_STP_violated will be passed down the reaction
     //  chain until it is dealt with in a downstream STP handler.
     if (reaction->is_STP_violated == true) {
-        reaction_function_t handler = reaction->STP_handler;
+        LF_REACTION_FPTRGROUP reaction_function_t handler = reaction->STP_handler;
         LF_PRINT_LOG("STP violation detected.");
 
         // Invoke the STP handler if there is one.
@@ -953,6 +1072,16 @@ void _lf_worker_do_work(int worker_number) {
             lf_sched_get_ready_reaction(worker_number))
             != NULL) {
         // Got a reaction that is ready to run.
+#ifdef LF_TAG_STATS
+        if (!_lf_tag_start_measured && _lf_worker_bool_compare_and_swap(&_lf_tag_start_measured, false, true)) {
+            interval_t lateness = lf_time_physical() - current_tag.time;
+            _lf_tag_starts++;
+            _lf_tag_start_lateness_total += lateness;
+            if (lateness > _lf_tag_start_lateness_max) {
+                _lf_tag_start_lateness_max = lateness;
+            }
+        }
+#endif
         LF_PRINT_DEBUG("Worker %d: Got from scheduler reaction %s: "
                 "level: %lld, is control reaction: %d, chain ID: %llu, and deadline " PRINTF_TIME ".",
                 worker_number,
@@ -989,6 +1118,8 @@ void* worker(void* arg) {
     int worker_number = worker_thread_count++;
     LF_PRINT_LOG("Worker thread %d started.", worker_number);
     lf_mutex_unlock(&mutex);
+    lf_thread_context()->worker_number = worker_number;
+    _lf_token_cache_attach(worker_number);
 
     _lf_worker_do_work(worker_number);
 
@@ -1128,11 +1259,18 @@ int lf_reactor_c_main(int argc, const char* argv[]) {
         lf_sched_init(
             (size_t)_lf_number_of_workers,
             NULL);
+        // Depot of the per-worker token caches. Its lock is only taken once
+        // per magazine, so it comes after the scheduler, which may need the
+        // spare hardware lock for a lock on its hot path.
+        _lf_token_caches_init();
 
         // Call the following function only once, rather than per worker thread (although
         // it can be probably called in that manner as well).
         _lf_initialize_start_tag();
 
+#ifdef LF_BACKGROUND_THREADS
+        lf_background_init();
+#endif
         start_threads();
 
         lf_mutex_unlock(&mutex);
@@ -1153,9 +1291,33 @@ int lf_reactor_c_main(int argc, const char* argv[]) {
         	}
         }
 
+#ifdef LF_BACKGROUND_THREADS
+        lf_background_free();
+#endif
+        // Tokens freed from now on, including by termination(), go to the
+        // recycling bin.
+        _lf_token_caches_free();
+
         if (ret == 0) {
             LF_PRINT_LOG("---- All worker threads exited successfully.");
         }
+#ifdef LF_TAG_STATS
+        if (!fast && _lf_tag_starts > 0) {
+            lf_print("---- Tag start lateness: average " PRINTF_TIME " ns, maximum " PRINTF_TIME " ns over %d tags.",
+                    _lf_tag_start_lateness_total / _lf_tag_starts, _lf_tag_start_lateness_max, _lf_tag_starts);
+        }
+#endif
+#ifdef LF_DEADLINE_STATS
+        if (_lf_deadline_checks > 0) {
+            lf_print("---- Deadline misses: %d of %d checks.", _lf_deadline_misses, _lf_deadline_checks);
+        }
+#endif
+#ifdef LF_MUTEX_STATS
+        lf_xmos_mutex_stats_t mutex_stats;
+        lf_xmos_mutex_stats(&mutex, &mutex_stats);
+        lf_print("---- Global mutex: %d acquisitions, %d contended, waited " PRINTF_TIME " ns, held " PRINTF_TIME " ns.",
+                mutex_stats.acquisitions, mutex_stats.contended, mutex_stats.wait_time, mutex_stats.hold_time);
+#endif
 
         lf_sched_free();
         free(_lf_thread_ids);
@@ -0,0 +1,247 @@
+/**
+ * Channel-based scheduler with a dispatcher thread.
+ *
+ * Worker 0 becomes the dispatcher. It exclusively owns the reaction queue,
+ * the level barrier and the advancement of the tag, and hands ready
+ * reactions to idle workers by sending the reaction pointer over the
+ * worker's channel. Workers report triggered reactions and completions back
+ * over the dispatcher's channel, so the worker loop never takes a lock.
+ * Since messages from one worker arrive in order, the reactions a worker
+ * triggers are always known to the dispatcher before its completion.
+ *
+ * Messages to the dispatcher are reaction pointers for triggers and odd
+ * words ((worker_number << 1) | 1) for completions. A NULL reaction tells a
+ * worker to stop.
+ *
+ * The dispatcher only takes the global mutex to advance the tag. As it does
+ * not execute reactions itself, this scheduler needs at least two workers.
+ */
+
+#ifndef NUMBER_OF_WORKERS
+#define NUMBER_OF_WORKERS 1
+#endif // NUMBER_OF_WORKERS
+
+#include "../lf_platform.h"
+#include "../platform/lf_channel.h"
+#include "../utils/pqueue.h"
+#include "../utils/pqueue_support.h"
+#include "../utils/util.h"
+#include "scheduler.h"
+#include "scheduler_sync_tag_advance.c"
+
+/////////////////// External Variables /////////////////////////
+extern lf_mutex_t mutex;
+
+/////////////////// Scheduler Variables and Structs /////////////////////////
+#define DISPATCHER 0
+#define DONE_MESSAGE(worker_number) ((((uintptr_t) (worker_number)) << 1) | 1)
+#define IS_DONE_MESSAGE(message) ((message) & 1)
+#define DONE_WORKER(message) ((int) ((message) >> 1))
+
+typedef struct {
+    // Channel on which the worker receives reactions.
+    lf_channel_t inbox;
+    // Sending end of 'inbox', used by the dispatcher.
+    lf_channel_sender_t to_worker;
+    // Sending end of the dispatcher's channel, used by the worker.
+    lf_channel_sender_t to_dispatcher;
+} _lf_sched_worker_t;
+
+static _lf_sched_worker_t _lf_sched_workers[NUMBER_OF_WORKERS];
+static size_t _lf_sched_number_of_workers = 1;
+
+// Channel on which the dispatcher receives triggers and completions.
+static lf_channel_t _lf_sched_dispatcher_inbox;
+
+// State owned by the dispatcher.
+static pqueue_t* _lf_sched_ready_q;
+static int _lf_sched_idle_workers[NUMBER_OF_WORKERS];
+static size_t _lf_sched_number_of_idle_workers = 0;
+static size_t _lf_sched_executing = 0;
+static size_t _lf_sched_current_level = 0;
+
+/////////////////// Scheduler Private API /////////////////////////
+/**
+ * Queue a triggered reaction. Only called by the dispatcher.
+ */
+static void _lf_sched_enqueue(reaction_t* reaction) {
+    if (reaction->status == inactive) {
+        LF_PRINT_DEBUG("Scheduler: Enqueing reaction %s, which has level %lld.",
+                reaction->name, LEVEL(reaction->index));
+        reaction->status = queued;
+        pqueue_insert(_lf_sched_ready_q, reaction);
+    }
+}
+
+/**
+ * Send reactions of the current level to idle workers.
+ */
+static void _lf_sched_dispatch() {
+    while (_lf_sched_number_of_idle_workers > 0) {
+        reaction_t* head = (reaction_t*) pqueue_peek(_lf_sched_ready_q);
+        if (head == NULL || LEVEL(head->index) != _lf_sched_current_level) {
+            return;
+        }
+        int worker_number = _lf_sched_idle_workers[--_lf_sched_number_of_idle_workers];
+        _lf_sched_executing++;
+        lf_channel_send(&_lf_sched_workers[worker_number].to_worker, (uintptr_t) pqueue_pop(_lf_sched_ready_q));
+    }
+}
+
+/**
+ * Main loop of the dispatcher.
+ */
+static void _lf_sched_run_dispatcher() {
+    while (true) {
+        _lf_sched_dispatch();
+        if (_lf_sched_executing == 0) {
+            reaction_t* head = (reaction_t*) pqueue_peek(_lf_sched_ready_q);
+            if (head != NULL) {
+                // The current level is done.
+                _lf_sched_current_level = LEVEL(head->index);
+                continue;
+            }
+            // The tag is done.
+            lf_mutex_lock(&mutex);
+            bool stop = _lf_sched_advance_tag_locked();
+            lf_mutex_unlock(&mutex);
+            if (stop) {
+                break;
+            }
+            head = (reaction_t*) pqueue_peek(_lf_sched_ready_q);
+            _lf_sched_current_level = head != NULL ? LEVEL(head->index) : 0;
+            continue;
+        }
+        uintptr_t message = lf_channel_receive(&_lf_sched_dispatcher_inbox);
+        if (IS_DONE_MESSAGE(message)) {
+            _lf_sched_idle_workers[_lf_sched_number_of_idle_workers++] = DONE_WORKER(message);
+            _lf_sched_executing--;
+        } else {
+            _lf_sched_enqueue((reaction_t*) message);
+        }
+    }
+    // Tell all workers to stop. They are all idle at this point.
+    for (size_t i = 0; i < _lf_sched_number_of_workers; i++) {
+        if (i != DISPATCHER) {
+            lf_channel_send(&_lf_sched_workers[i].to_worker, (uintptr_t) NULL);
+        }
+    }
+}
+
+///////////////////// Scheduler Init and Destroy API /////////////////////////
+/**
+ * @brief Initialize the scheduler.
+ *
+ * This has to be called before other functions of the scheduler can be used.
+ * The mutex is expected to be held by the caller.
+ *
+ * @param number_of_workers Indicate how many workers this scheduler will be
+ *  managing.
+ * @param parameters Unused by this scheduler.
+ */
+void lf_sched_init(size_t number_of_workers, sched_params_t* parameters) {
+    LF_PRINT_DEBUG("Scheduler: Initializing with %zu workers.", number_of_workers);
+    if (number_of_workers < 2 || number_of_workers > NUMBER_OF_WORKERS) {
+        lf_print_error_and_exit("Scheduler: The channel scheduler needs between 2 and %d workers.",
+                NUMBER_OF_WORKERS);
+    }
+    _lf_sched_number_of_workers = number_of_workers;
+    if (lf_channel_init(&_lf_sched_dispatcher_inbox) != 0) {
+        lf_print_error_and_exit("Scheduler: Out of channels.");
+    }
+    for (size_t i = 0; i < number_of_workers; i++) {
+        if (i == DISPATCHER) {
+            continue;
+        }
+        _lf_sched_worker_t* worker = &_lf_sched_workers[i];
+        if (lf_channel_init(&worker->inbox) != 0
+                || lf_channel_connect(&worker->inbox, &worker->to_worker) != 0
+                || lf_channel_connect(&_lf_sched_dispatcher_inbox, &worker->to_dispatcher) != 0) {
+            lf_print_error_and_exit("Scheduler: Out of channels.");
+        }
+        _lf_sched_idle_workers[_lf_sched_number_of_idle_workers++] = i;
+    }
+    _lf_sched_ready_q = pqueue_init(INITIAL_REACT_QUEUE_SIZE, in_reverse_order, get_reaction_index,
+            get_reaction_position, set_reaction_position, reaction_matches, print_reaction);
+}
+
+/**
+ * @brief Free the memory used by the scheduler.
+ *
+ * This must be called when the scheduler is no longer needed.
+ */
+void lf_sched_free() {
+    for (size_t i = 0; i < _lf_sched_number_of_workers; i++) {
+        if (i == DISPATCHER) {
+            continue;
+        }
+        lf_channel_disconnect(&_lf_sched_workers[i].to_worker);
+        lf_channel_disconnect(&_lf_sched_workers[i].to_dispatcher);
+        lf_channel_free(&_lf_sched_workers[i].inbox);
+    }
+    lf_channel_free(&_lf_sched_dispatcher_inbox);
+    pqueue_free(_lf_sched_ready_q);
+}
+
+///////////////////// Scheduler Worker API (public) /////////////////////////
+/**
+ * @brief Ask the scheduler for one more reaction.
+ *
+ * Worker 0 runs the dispatcher until execution stops and then returns NULL.
+ * Other workers block on their channel until the dispatcher sends them a
+ * reaction.
+ *
+ * @param worker_number The worker number of the worker thread asking for work
+ * to be assigned to it.
+ * @return reaction_t* A reaction for the worker to execute. NULL if the calling
+ * worker thread should exit.
+ */
+reaction_t* lf_sched_get_ready_reaction(int worker_number) {
+    if (worker_number == DISPATCHER) {
+        _lf_sched_run_dispatcher();
+        return NULL;
+    }
+    return (reaction_t*) lf_channel_receive(&_lf_sched_workers[worker_number].inbox);
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' is done
+ * executing the 'done_reaction'.
+ *
+ * @param worker_number The worker number for the worker thread that has
+ * finished executing 'done_reaction'.
+ * @param done_reaction The reaction that is done.
+ */
+void lf_sched_done_with_reaction(size_t worker_number, reaction_t* done_reaction) {
+    if (done_reaction->status != queued) {
+        lf_print_error_and_exit("Unexpected reaction status: %d. Expected %d.",
+                done_reaction->status, queued);
+    }
+    done_reaction->status = inactive;
+    lf_channel_send(&_lf_sched_workers[worker_number].to_dispatcher, DONE_MESSAGE(worker_number));
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' would like to
+ * trigger 'reaction' at the current tag.
+ *
+ * Workers send the reaction to the dispatcher. Calls with worker number -1
+ * are made by the dispatcher itself while it advances the tag, and go
+ * directly to the queue.
+ *
+ * @param reaction The reaction to trigger at the current tag.
+ * @param worker_number The ID of the worker that is making this call. 0 should
+ * be used if there is only one worker (e.g., when the program is using the
+ * unthreaded C runtime). -1 is used for an anonymous call in a context where a
+ * worker number does not make sense (e.g., the caller is not a worker thread).
+ */
+void lf_sched_trigger_reaction(reaction_t* reaction, int worker_number) {
+    if (reaction == NULL) {
+        return;
+    }
+    if (worker_number <= DISPATCHER) {
+        _lf_sched_enqueue(reaction);
+    } else {
+        lf_channel_send(&_lf_sched_workers[worker_number].to_dispatcher, (uintptr_t) reaction);
+    }
+}
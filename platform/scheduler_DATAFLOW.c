@@ -0,0 +1,192 @@
+/**
+ * Dataflow scheduler without level barriers.
+ *
+ * Instead of releasing the reactions of a tag level by level, this scheduler
+ * counts for each triggered reaction how many of its predecessors are still
+ * in flight (see scheduler_dependencies.c). A reaction is handed to a worker as
+ * soon as that count drops to zero, so a fast reaction is not held back by
+ * an unrelated slow reaction at a lower level. Ready reactions are ordered by
+ * level and deadline. The tag advances once no reaction is in flight anymore.
+ *
+ * FIXME: Reactions of the next tag are not started while reactions of the
+ * current tag are in flight. That needs current_tag and the port state, which
+ * the generated code reads directly, to exist once per tag in flight.
+ * Consecutive tags are only pipelined by the actor engine (lf_actor.h).
+ *
+ * All scheduler state is protected by the global mutex.
+ */
+
+#ifndef NUMBER_OF_WORKERS
+#define NUMBER_OF_WORKERS 1
+#endif // NUMBER_OF_WORKERS
+
+#include "../lf_platform.h"
+#include "../platform/lf_parallel_for.h"
+#include "../utils/pqueue.h"
+#include "../utils/pqueue_support.h"
+#include "../utils/util.h"
+#include "scheduler.h"
+#include "scheduler_dependencies.c"
+#include "scheduler_sync_tag_advance.c"
+
+/////////////////// External Variables /////////////////////////
+extern lf_mutex_t mutex;
+
+/////////////////// Scheduler Variables and Structs /////////////////////////
+// Reactions whose predecessors have all completed.
+static pqueue_t* _lf_sched_ready_q;
+
+// Condition variable on which idle workers wait.
+static lf_cond_t _lf_sched_work_available;
+
+// Indicator that a worker is advancing the tag. The global mutex is released
+// while waiting for physical time, so other workers have to check this.
+static bool _lf_sched_advancing = false;
+static bool _lf_sched_should_stop = false;
+
+/////////////////// Scheduler Private API /////////////////////////
+/**
+ * Make a reaction available to the workers.
+ * This assumes the mutex is held.
+ */
+static void _lf_sched_release_locked(reaction_t* reaction) {
+    LF_PRINT_DEBUG("Scheduler: Releasing reaction %s.", reaction->name);
+    pqueue_insert(_lf_sched_ready_q, reaction);
+    lf_cond_signal(&_lf_sched_work_available);
+}
+
+/**
+ * Wake all idle workers so that they help with a parallel loop.
+ * This assumes the mutex is held.
+ */
+static void _lf_sched_wake_all_locked() {
+    lf_cond_broadcast(&_lf_sched_work_available);
+}
+
+///////////////////// Scheduler Init and Destroy API /////////////////////////
+/**
+ * @brief Initialize the scheduler.
+ *
+ * This has to be called before other functions of the scheduler can be used.
+ * The mutex is expected to be held by the caller.
+ *
+ * @param number_of_workers Indicate how many workers this scheduler will be
+ *  managing.
+ * @param parameters Unused by this scheduler.
+ */
+void lf_sched_init(size_t number_of_workers, sched_params_t* parameters) {
+    LF_PRINT_DEBUG("Scheduler: Initializing with %zu workers.", number_of_workers);
+    _lf_sched_ready_q = pqueue_init(INITIAL_REACT_QUEUE_SIZE, in_reverse_order, get_reaction_index,
+            get_reaction_position, set_reaction_position, reaction_matches, print_reaction);
+    lf_cond_init(&_lf_sched_work_available);
+    _lf_dep_init(INITIAL_REACT_QUEUE_SIZE);
+    lf_parallel_for_init(_lf_sched_wake_all_locked);
+}
+
+/**
+ * @brief Free the memory used by the scheduler.
+ *
+ * This must be called when the scheduler is no longer needed.
+ */
+void lf_sched_free() {
+    pqueue_free(_lf_sched_ready_q);
+    _lf_dep_free();
+}
+
+///////////////////// Scheduler Worker API (public) /////////////////////////
+/**
+ * @brief Ask the scheduler for one more reaction.
+ *
+ * This function blocks until it can return a reaction whose predecessors at
+ * the current tag have all completed, or NULL if execution should stop.
+ * The last worker to find nothing in flight advances the tag.
+ *
+ * @param worker_number The worker number of the worker thread asking for work
+ * to be assigned to it.
+ * @return reaction_t* A reaction for the worker to execute. NULL if the calling
+ * worker thread should exit.
+ */
+reaction_t* lf_sched_get_ready_reaction(int worker_number) {
+    lf_mutex_lock(&mutex);
+    while (!_lf_sched_should_stop) {
+        if (_lf_dep_held() && !_lf_sched_advancing) {
+            // The startup reactions have been triggered before the workers
+            // started.
+            _lf_dep_release_held_locked(_lf_sched_release_locked);
+        }
+        reaction_t* reaction = (reaction_t*) pqueue_pop(_lf_sched_ready_q);
+        if (reaction != NULL) {
+            lf_mutex_unlock(&mutex);
+            return reaction;
+        }
+        if (_lf_dep_in_flight_count() == 0 && !_lf_sched_advancing) {
+            _lf_sched_advancing = true;
+            // Release the reactions of the new tag only once all its events
+            // have triggered theirs, see scheduler_dependencies.c.
+            _lf_dep_hold_locked();
+            _lf_sched_should_stop = _lf_sched_advance_tag_locked();
+            _lf_dep_release_held_locked(_lf_sched_release_locked);
+            _lf_sched_advancing = false;
+            lf_cond_broadcast(&_lf_sched_work_available);
+            continue;
+        }
+        if (lf_parallel_for_help()) {
+            continue;
+        }
+        LF_PRINT_DEBUG("Scheduler: Worker %d is waiting for work.", worker_number);
+        lf_cond_wait(&_lf_sched_work_available, &mutex);
+    }
+    lf_mutex_unlock(&mutex);
+    return NULL;
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' is done
+ * executing the 'done_reaction'.
+ *
+ * Successors that were only waiting for 'done_reaction' become ready.
+ *
+ * @param worker_number The worker number for the worker thread that has
+ * finished executing 'done_reaction'.
+ * @param done_reaction The reaction that is done.
+ */
+void lf_sched_done_with_reaction(size_t worker_number, reaction_t* done_reaction) {
+    lf_mutex_lock(&mutex);
+    if (done_reaction->status != queued) {
+        lf_print_error_and_exit("Unexpected reaction status: %d. Expected %d.",
+                done_reaction->status, queued);
+    }
+    done_reaction->status = inactive;
+    _lf_dep_remove_locked(done_reaction, _lf_sched_release_locked);
+    if (_lf_dep_in_flight_count() == 0) {
+        // Wake up a worker to advance the tag.
+        lf_cond_signal(&_lf_sched_work_available);
+    }
+    lf_mutex_unlock(&mutex);
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' would like to
+ * trigger 'reaction' at the current tag.
+ *
+ * If a reaction is already queued at the current tag, it is not queued again.
+ *
+ * @param reaction The reaction to trigger at the current tag.
+ * @param worker_number The ID of the worker that is making this call. 0 should
+ * be used if there is only one worker (e.g., when the program is using the
+ * unthreaded C runtime). -1 is used for an anonymous call in a context where a
+ * worker number does not make sense (e.g., the caller is not a worker thread).
+ */
+void lf_sched_trigger_reaction(reaction_t* reaction, int worker_number) {
+    if (reaction == NULL) {
+        return;
+    }
+    lf_mutex_lock(&mutex);
+    if (reaction->status == inactive) {
+        reaction->status = queued;
+        if (_lf_dep_add_locked(reaction)) {
+            _lf_sched_release_locked(reaction);
+        }
+    }
+    lf_mutex_unlock(&mutex);
+}
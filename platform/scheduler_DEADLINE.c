@@ -0,0 +1,278 @@
+/**
+ * Non-preemptive level scheduler with workers reserved for deadline reactions.
+ *
+ * Reactions whose deadline is below LF_DEADLINE_THRESHOLD are put on their own
+ * ready queue. The first LF_DEADLINE_WORKERS workers only ever execute
+ * reactions from that queue, so a reaction with a tight deadline never waits
+ * for a long best-effort reaction to release a worker. The remaining (general)
+ * workers execute best-effort reactions and help with deadline reactions when
+ * they are idle. Only general workers help with parallel loops
+ * (lf_parallel_for.h).
+ *
+ * Both queues are ordered by level and then by deadline and are protected by
+ * the global mutex. Reactions of a level are only released once every
+ * reaction of the previous level has completed.
+ *
+ * Compile definitions:
+ *  - LF_DEADLINE_WORKERS: Number of reserved workers (default 1). At least one
+ *    general worker is always kept.
+ *  - LF_DEADLINE_THRESHOLD: Reactions with a deadline strictly below this
+ *    interval are deadline reactions (default 1 msec).
+ */
+
+#ifndef NUMBER_OF_WORKERS
+#define NUMBER_OF_WORKERS 1
+#endif // NUMBER_OF_WORKERS
+
+#include "../lf_platform.h"
+#include "../platform/lf_parallel_for.h"
+#include "../utils/pqueue.h"
+#include "../utils/pqueue_support.h"
+#include "../utils/util.h"
+#include "scheduler.h"
+#include "scheduler_sync_tag_advance.c"
+
+#ifndef LF_DEADLINE_WORKERS
+#define LF_DEADLINE_WORKERS 1
+#endif
+
+#ifndef LF_DEADLINE_THRESHOLD
+#define LF_DEADLINE_THRESHOLD MSEC(1)
+#endif
+
+/////////////////// External Variables /////////////////////////
+extern lf_mutex_t mutex;
+
+/////////////////// Scheduler Variables and Structs /////////////////////////
+#define GENERAL_Q 0
+#define DEADLINE_Q 1
+
+// Reaction queues, indexed by GENERAL_Q and DEADLINE_Q.
+static pqueue_t* _lf_sched_q[2];
+
+// Condition variables on which idle general and reserved workers wait.
+static lf_cond_t _lf_sched_work_available[2];
+
+// The level that is currently being executed.
+static size_t _lf_sched_current_level = 0;
+
+// Number of reactions handed out to workers and not yet done.
+static size_t _lf_sched_executing = 0;
+
+static size_t _lf_sched_number_of_workers = 1;
+static size_t _lf_sched_reserved_workers = 0;
+
+// Indicator that a worker is advancing the tag. The global mutex is released
+// while waiting for physical time, so other workers have to check this.
+static bool _lf_sched_advancing = false;
+static bool _lf_sched_should_stop = false;
+
+/////////////////// Scheduler Private API /////////////////////////
+/**
+ * Priority of a reaction on the ready queues. The level is put in the most
+ * significant bits so that the queues are ordered by level first, and
+ * the (inferred) deadline carried in the upper bits of the index second.
+ */
+static pqueue_pri_t _lf_sched_get_priority(void* reaction) {
+    index_t index = ((reaction_t*) reaction)->index;
+    return (LEVEL(index) << 48) | (index >> 16);
+}
+
+static inline int _lf_sched_queue_for(reaction_t* reaction) {
+    if (reaction->deadline >= 0LL && reaction->deadline < LF_DEADLINE_THRESHOLD) {
+        return DEADLINE_Q;
+    }
+    return GENERAL_Q;
+}
+
+static inline void _lf_sched_wake_all_locked() {
+    lf_cond_broadcast(&_lf_sched_work_available[GENERAL_Q]);
+    lf_cond_broadcast(&_lf_sched_work_available[DEADLINE_Q]);
+}
+
+/**
+ * Wake the general workers to help with a parallel loop. Reserved workers
+ * stay available for deadline reactions and do not help.
+ */
+static void _lf_sched_wake_general_locked() {
+    lf_cond_broadcast(&_lf_sched_work_available[GENERAL_Q]);
+}
+
+/**
+ * Move to the lowest level that has queued reactions.
+ * This assumes the mutex is held and that no reaction is executing.
+ * @return true if there is a reaction to execute, false if the tag is complete.
+ */
+static bool _lf_sched_next_level_locked() {
+    bool found = false;
+    size_t level = 0;
+    for (int q = GENERAL_Q; q <= DEADLINE_Q; q++) {
+        reaction_t* head = (reaction_t*) pqueue_peek(_lf_sched_q[q]);
+        if (head != NULL && (!found || LEVEL(head->index) < level)) {
+            level = LEVEL(head->index);
+            found = true;
+        }
+    }
+    if (found) {
+        _lf_sched_current_level = level;
+    }
+    return found;
+}
+
+/**
+ * Pop a reaction of the current level that the given kind of worker may execute.
+ * Deadline reactions are preferred also by general workers.
+ * This assumes the mutex is held.
+ */
+static reaction_t* _lf_sched_pop_locked(bool reserved) {
+    int last_q = reserved ? DEADLINE_Q : GENERAL_Q;
+    for (int q = DEADLINE_Q; q >= last_q; q--) {
+        reaction_t* head = (reaction_t*) pqueue_peek(_lf_sched_q[q]);
+        if (head != NULL && LEVEL(head->index) == _lf_sched_current_level) {
+            return (reaction_t*) pqueue_pop(_lf_sched_q[q]);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Advance the tag and release the first level of the new tag.
+ * This assumes the mutex is held and that no reaction is executing.
+ */
+static void _lf_sched_advance_locked() {
+    _lf_sched_advancing = true;
+    _lf_sched_should_stop = _lf_sched_advance_tag_locked();
+    _lf_sched_advancing = false;
+    _lf_sched_next_level_locked();
+    _lf_sched_wake_all_locked();
+}
+
+///////////////////// Scheduler Init and Destroy API /////////////////////////
+/**
+ * @brief Initialize the scheduler.
+ *
+ * This has to be called before other functions of the scheduler can be used.
+ * The mutex is expected to be held by the caller.
+ *
+ * @param number_of_workers Indicate how many workers this scheduler will be
+ *  managing.
+ * @param parameters Unused by this scheduler.
+ */
+void lf_sched_init(size_t number_of_workers, sched_params_t* parameters) {
+    LF_PRINT_DEBUG("Scheduler: Initializing with %zu workers.", number_of_workers);
+    _lf_sched_number_of_workers = number_of_workers;
+    _lf_sched_reserved_workers = LF_DEADLINE_WORKERS;
+    if (_lf_sched_reserved_workers >= number_of_workers) {
+        // Keep at least one general worker.
+        _lf_sched_reserved_workers = number_of_workers - 1;
+    }
+    LF_PRINT_LOG("Scheduler: Reserving %zu of %zu workers for reactions with a deadline below " PRINTF_TIME ".",
+            _lf_sched_reserved_workers, number_of_workers, (instant_t) LF_DEADLINE_THRESHOLD);
+
+    for (int q = GENERAL_Q; q <= DEADLINE_Q; q++) {
+        _lf_sched_q[q] = pqueue_init(INITIAL_REACT_QUEUE_SIZE, in_reverse_order, _lf_sched_get_priority,
+                get_reaction_position, set_reaction_position, reaction_matches, print_reaction);
+        lf_cond_init(&_lf_sched_work_available[q]);
+    }
+    lf_parallel_for_init(_lf_sched_wake_general_locked);
+}
+
+/**
+ * @brief Free the memory used by the scheduler.
+ *
+ * This must be called when the scheduler is no longer needed.
+ */
+void lf_sched_free() {
+    pqueue_free(_lf_sched_q[GENERAL_Q]);
+    pqueue_free(_lf_sched_q[DEADLINE_Q]);
+}
+
+///////////////////// Scheduler Worker API (public) /////////////////////////
+/**
+ * @brief Ask the scheduler for one more reaction.
+ *
+ * Reserved workers only get reactions from the deadline queue. This function
+ * blocks until it can return a ready reaction for the worker, or NULL if
+ * execution should stop.
+ *
+ * @param worker_number The worker number of the worker thread asking for work
+ * to be assigned to it.
+ * @return reaction_t* A reaction for the worker to execute. NULL if the calling
+ * worker thread should exit.
+ */
+reaction_t* lf_sched_get_ready_reaction(int worker_number) {
+    bool reserved = (size_t) worker_number < _lf_sched_reserved_workers;
+    lf_mutex_lock(&mutex);
+    while (!_lf_sched_should_stop) {
+        reaction_t* reaction = _lf_sched_pop_locked(reserved);
+        if (reaction != NULL) {
+            _lf_sched_executing++;
+            lf_mutex_unlock(&mutex);
+            return reaction;
+        }
+        if (_lf_sched_executing == 0 && !_lf_sched_advancing) {
+            // The current level is done.
+            if (_lf_sched_next_level_locked()) {
+                _lf_sched_wake_all_locked();
+            } else {
+                _lf_sched_advance_locked();
+            }
+            continue;
+        }
+        if (!reserved && lf_parallel_for_help()) {
+            continue;
+        }
+        LF_PRINT_DEBUG("Scheduler: Worker %d is waiting for work.", worker_number);
+        lf_cond_wait(&_lf_sched_work_available[reserved ? DEADLINE_Q : GENERAL_Q], &mutex);
+    }
+    lf_mutex_unlock(&mutex);
+    return NULL;
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' is done
+ * executing the 'done_reaction'.
+ *
+ * @param worker_number The worker number for the worker thread that has
+ * finished executing 'done_reaction'.
+ * @param done_reaction The reaction that is done.
+ */
+void lf_sched_done_with_reaction(size_t worker_number, reaction_t* done_reaction) {
+    lf_mutex_lock(&mutex);
+    if (done_reaction->status != queued) {
+        lf_print_error_and_exit("Unexpected reaction status: %d. Expected %d.",
+                done_reaction->status, queued);
+    }
+    done_reaction->status = inactive;
+    _lf_sched_executing--;
+    if (_lf_sched_executing == 0 && _lf_sched_next_level_locked()) {
+        _lf_sched_wake_all_locked();
+    }
+    lf_mutex_unlock(&mutex);
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' would like to
+ * trigger 'reaction' at the current tag.
+ *
+ * If a reaction is already queued at the current tag, it is not queued again.
+ *
+ * @param reaction The reaction to trigger at the current tag.
+ * @param worker_number The ID of the worker that is making this call. 0 should
+ * be used if there is only one worker (e.g., when the program is using the
+ * unthreaded C runtime). -1 is used for an anonymous call in a context where a
+ * worker number does not make sense (e.g., the caller is not a worker thread).
+ */
+void lf_sched_trigger_reaction(reaction_t* reaction, int worker_number) {
+    if (reaction == NULL) {
+        return;
+    }
+    lf_mutex_lock(&mutex);
+    if (reaction->status == inactive) {
+        LF_PRINT_DEBUG("Scheduler: Enqueing reaction %s, which has level %lld.",
+                reaction->name, LEVEL(reaction->index));
+        reaction->status = queued;
+        pqueue_insert(_lf_sched_q[_lf_sched_queue_for(reaction)], reaction);
+    }
+    lf_mutex_unlock(&mutex);
+}
@@ -0,0 +1,335 @@
+/**
+ * Non-preemptive level scheduler with an elastic pool of workers.
+ *
+ * On XCore, every thread that is runnable takes issue slots from the others.
+ * Idle workers therefore park on their own channel (lf_channel.h), which
+ * deschedules the hardware thread until it is woken with a message. Instead
+ * of waking every worker when work is released, only as many workers are
+ * woken as the pool size. The pool grows at once to the number of ready
+ * reactions and shrinks gradually as the average observed ready-queue depth
+ * decreases, always staying between LF_ELASTIC_MIN_WORKERS and the number of
+ * workers. A narrow reaction graph is then executed by few threads that
+ * each get more of the pipeline, and a wide one by all of them.
+ *
+ * Reactions of a level are only released once every reaction of the
+ * previous level has completed. The queues are protected by the global
+ * mutex.
+ *
+ * Compile definitions:
+ *  - LF_ELASTIC_MIN_WORKERS: Minimum pool size (default 1).
+ */
+
+#ifndef NUMBER_OF_WORKERS
+#define NUMBER_OF_WORKERS 1
+#endif // NUMBER_OF_WORKERS
+
+#include <stdlib.h>
+
+#include "../lf_platform.h"
+#include "../platform/lf_channel.h"
+#include "../platform/lf_parallel_for.h"
+#include "../utils/pqueue.h"
+#include "../utils/pqueue_support.h"
+#include "../utils/util.h"
+#include "scheduler.h"
+#include "scheduler_sync_tag_advance.c"
+
+#ifndef LF_ELASTIC_MIN_WORKERS
+#define LF_ELASTIC_MIN_WORKERS 1
+#endif
+
+/////////////////// External Variables /////////////////////////
+extern lf_mutex_t mutex;
+
+/////////////////// Scheduler Variables and Structs /////////////////////////
+typedef struct {
+    // Channel on which the worker is parked.
+    lf_channel_t park;
+    // Sending end of 'park'. Only used with the mutex held.
+    lf_channel_sender_t wake;
+} _lf_sched_worker_t;
+
+static _lf_sched_worker_t _lf_sched_workers[NUMBER_OF_WORKERS];
+static size_t _lf_sched_number_of_workers = 1;
+
+// Reactions of later levels.
+static pqueue_t* _lf_sched_ready_q;
+
+// The level that is currently being executed.
+static size_t _lf_sched_current_level = 0;
+
+// Reactions of the current level that have been released to the workers.
+static reaction_t** _lf_sched_level = NULL;
+static size_t _lf_sched_level_capacity = 0;
+static size_t _lf_sched_level_size = 0;
+static size_t _lf_sched_level_head = 0;
+
+// Number of reactions handed out to workers and not yet done.
+static size_t _lf_sched_executing = 0;
+
+// Stack of parked workers.
+static int _lf_sched_parked[NUMBER_OF_WORKERS];
+static size_t _lf_sched_number_parked = 0;
+
+// Target number of workers that are not parked.
+static size_t _lf_sched_pool_size = 1;
+static size_t _lf_sched_min_pool_size = 1;
+
+// Average ready-queue depth at the release of a level, times 4.
+static size_t _lf_sched_depth_x4 = 0;
+
+// Indicator that a worker is advancing the tag. The global mutex is released
+// while waiting for physical time, so other workers have to check this.
+static bool _lf_sched_advancing = false;
+static bool _lf_sched_should_stop = false;
+
+/////////////////// Scheduler Private API /////////////////////////
+/**
+ * Move the queued reactions of the current level to the released level,
+ * resize the pool according to their number and wake parked workers until
+ * the pool is full.
+ * This assumes the mutex is held and that the released level is empty.
+ */
+static void _lf_sched_release_locked() {
+    _lf_sched_level_head = 0;
+    _lf_sched_level_size = 0;
+    reaction_t* head;
+    while ((head = (reaction_t*) pqueue_peek(_lf_sched_ready_q)) != NULL
+            && LEVEL(head->index) == _lf_sched_current_level) {
+        if (_lf_sched_level_size == _lf_sched_level_capacity) {
+            _lf_sched_level_capacity = _lf_sched_level_capacity ? 2 * _lf_sched_level_capacity : 8;
+            _lf_sched_level = (reaction_t**) realloc(_lf_sched_level,
+                    _lf_sched_level_capacity * sizeof(reaction_t*));
+            if (_lf_sched_level == NULL) {
+                lf_print_error_and_exit("Scheduler: Out of memory.");
+            }
+        }
+        _lf_sched_level[_lf_sched_level_size++] = (reaction_t*) pqueue_pop(_lf_sched_ready_q);
+    }
+    size_t ready = _lf_sched_level_size;
+    _lf_sched_depth_x4 = _lf_sched_depth_x4 - _lf_sched_depth_x4 / 4 + ready;
+    size_t size = (_lf_sched_depth_x4 + 3) / 4;
+    if (size < ready) {
+        size = ready;
+    }
+    if (size < _lf_sched_min_pool_size) {
+        size = _lf_sched_min_pool_size;
+    }
+    if (size > _lf_sched_number_of_workers) {
+        size = _lf_sched_number_of_workers;
+    }
+    _lf_sched_pool_size = size;
+    while (_lf_sched_number_parked > 0
+            && _lf_sched_number_of_workers - _lf_sched_number_parked < _lf_sched_pool_size) {
+        int worker = _lf_sched_parked[--_lf_sched_number_parked];
+        lf_channel_send(&_lf_sched_workers[worker].wake, 1);
+    }
+}
+
+static void _lf_sched_wake_all_locked() {
+    while (_lf_sched_number_parked > 0) {
+        int worker = _lf_sched_parked[--_lf_sched_number_parked];
+        lf_channel_send(&_lf_sched_workers[worker].wake, 1);
+    }
+}
+
+/**
+ * Move to the lowest level that has queued reactions.
+ * This assumes the mutex is held and that no reaction is executing.
+ * @return true if there is a reaction to execute, false if the tag is complete.
+ */
+static bool _lf_sched_next_level_locked() {
+    reaction_t* head = (reaction_t*) pqueue_peek(_lf_sched_ready_q);
+    if (head == NULL) {
+        return false;
+    }
+    _lf_sched_current_level = LEVEL(head->index);
+    return true;
+}
+
+/**
+ * Take a reaction of the released level.
+ * This assumes the mutex is held.
+ */
+static reaction_t* _lf_sched_pop_locked() {
+    if (_lf_sched_level_head < _lf_sched_level_size) {
+        return _lf_sched_level[_lf_sched_level_head++];
+    }
+    return NULL;
+}
+
+/**
+ * Advance the tag and release the first level of the new tag.
+ * This assumes the mutex is held and that no reaction is executing.
+ */
+static void _lf_sched_advance_locked() {
+    _lf_sched_advancing = true;
+    _lf_sched_should_stop = _lf_sched_advance_tag_locked();
+    _lf_sched_advancing = false;
+    if (_lf_sched_should_stop) {
+        _lf_sched_wake_all_locked();
+    } else if (_lf_sched_next_level_locked()) {
+        _lf_sched_release_locked();
+    }
+}
+
+/**
+ * Park the calling worker until it is woken.
+ * This assumes the mutex is held. It is released while parked.
+ */
+static void _lf_sched_park_locked(int worker_number) {
+    LF_PRINT_DEBUG("Scheduler: Worker %d is parking.", worker_number);
+    _lf_sched_parked[_lf_sched_number_parked++] = worker_number;
+    lf_mutex_unlock(&mutex);
+    lf_channel_receive(&_lf_sched_workers[worker_number].park);
+    lf_mutex_lock(&mutex);
+}
+
+///////////////////// Scheduler Init and Destroy API /////////////////////////
+/**
+ * @brief Initialize the scheduler.
+ *
+ * This has to be called before other functions of the scheduler can be used.
+ * The mutex is expected to be held by the caller.
+ *
+ * @param number_of_workers Indicate how many workers this scheduler will be
+ *  managing.
+ * @param parameters Unused by this scheduler.
+ */
+void lf_sched_init(size_t number_of_workers, sched_params_t* parameters) {
+    LF_PRINT_DEBUG("Scheduler: Initializing with %zu workers.", number_of_workers);
+    if (number_of_workers > NUMBER_OF_WORKERS) {
+        lf_print_error_and_exit("Scheduler: Compiled for at most %d workers, got %zu.",
+                NUMBER_OF_WORKERS, number_of_workers);
+    }
+    _lf_sched_number_of_workers = number_of_workers;
+    _lf_sched_min_pool_size = LF_ELASTIC_MIN_WORKERS;
+    if (_lf_sched_min_pool_size < 1) {
+        _lf_sched_min_pool_size = 1;
+    }
+    if (_lf_sched_min_pool_size > number_of_workers) {
+        _lf_sched_min_pool_size = number_of_workers;
+    }
+    _lf_sched_pool_size = _lf_sched_min_pool_size;
+    LF_PRINT_LOG("Scheduler: Keeping between %zu and %zu workers active.",
+            _lf_sched_min_pool_size, number_of_workers);
+
+    _lf_sched_ready_q = pqueue_init(INITIAL_REACT_QUEUE_SIZE, in_reverse_order, get_reaction_index,
+            get_reaction_position, set_reaction_position, reaction_matches, print_reaction);
+    for (size_t i = 0; i < number_of_workers; i++) {
+        _lf_sched_worker_t* worker = &_lf_sched_workers[i];
+        if (lf_channel_init(&worker->park) != 0
+                || lf_channel_connect(&worker->park, &worker->wake) != 0) {
+            lf_print_error_and_exit("Scheduler: Out of channel resources.");
+        }
+    }
+    lf_parallel_for_init(_lf_sched_wake_all_locked);
+}
+
+/**
+ * @brief Free the memory used by the scheduler.
+ *
+ * This must be called when the scheduler is no longer needed.
+ */
+void lf_sched_free() {
+    for (size_t i = 0; i < _lf_sched_number_of_workers; i++) {
+        lf_channel_disconnect(&_lf_sched_workers[i].wake);
+        lf_channel_free(&_lf_sched_workers[i].park);
+    }
+    pqueue_free(_lf_sched_ready_q);
+    free(_lf_sched_level);
+}
+
+///////////////////// Scheduler Worker API (public) /////////////////////////
+/**
+ * @brief Ask the scheduler for one more reaction.
+ *
+ * This function blocks until it can return a ready reaction for the worker,
+ * or NULL if execution should stop. Workers beyond the pool size and workers
+ * without work park.
+ *
+ * @param worker_number The worker number of the worker thread asking for work
+ * to be assigned to it.
+ * @return reaction_t* A reaction for the worker to execute. NULL if the calling
+ * worker thread should exit.
+ */
+reaction_t* lf_sched_get_ready_reaction(int worker_number) {
+    lf_mutex_lock(&mutex);
+    while (!_lf_sched_should_stop) {
+        if (lf_parallel_for_help()) {
+            continue;
+        }
+        if (_lf_sched_number_of_workers - _lf_sched_number_parked > _lf_sched_pool_size) {
+            // The pool has shrunk.
+            _lf_sched_park_locked(worker_number);
+            continue;
+        }
+        reaction_t* reaction = _lf_sched_pop_locked();
+        if (reaction != NULL) {
+            _lf_sched_executing++;
+            lf_mutex_unlock(&mutex);
+            return reaction;
+        }
+        if (_lf_sched_executing == 0 && !_lf_sched_advancing) {
+            // The current level is done.
+            if (_lf_sched_next_level_locked()) {
+                _lf_sched_release_locked();
+            } else {
+                _lf_sched_advance_locked();
+            }
+            continue;
+        }
+        _lf_sched_park_locked(worker_number);
+    }
+    lf_mutex_unlock(&mutex);
+    return NULL;
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' is done
+ * executing the 'done_reaction'.
+ *
+ * @param worker_number The worker number for the worker thread that has
+ * finished executing 'done_reaction'.
+ * @param done_reaction The reaction that is done.
+ */
+void lf_sched_done_with_reaction(size_t worker_number, reaction_t* done_reaction) {
+    lf_mutex_lock(&mutex);
+    if (done_reaction->status != queued) {
+        lf_print_error_and_exit("Unexpected reaction status: %d. Expected %d.",
+                done_reaction->status, queued);
+    }
+    done_reaction->status = inactive;
+    _lf_sched_executing--;
+    if (_lf_sched_executing == 0 && _lf_sched_level_head == _lf_sched_level_size
+            && _lf_sched_next_level_locked()) {
+        _lf_sched_release_locked();
+    }
+    lf_mutex_unlock(&mutex);
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' would like to
+ * trigger 'reaction' at the current tag.
+ *
+ * If a reaction is already queued at the current tag, it is not queued again.
+ *
+ * @param reaction The reaction to trigger at the current tag.
+ * @param worker_number The ID of the worker that is making this call. 0 should
+ * be used if there is only one worker (e.g., when the program is using the
+ * unthreaded C runtime). -1 is used for an anonymous call in a context where a
+ * worker number does not make sense (e.g., the caller is not a worker thread).
+ */
+void lf_sched_trigger_reaction(reaction_t* reaction, int worker_number) {
+    if (reaction == NULL) {
+        return;
+    }
+    lf_mutex_lock(&mutex);
+    if (reaction->status == inactive) {
+        LF_PRINT_DEBUG("Scheduler: Enqueing reaction %s, which has level %lld.",
+                reaction->name, LEVEL(reaction->index));
+        reaction->status = queued;
+        pqueue_insert(_lf_sched_ready_q, reaction);
+    }
+    lf_mutex_unlock(&mutex);
+}
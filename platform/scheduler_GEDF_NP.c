@@ -0,0 +1,204 @@
+/**
+ * Global earliest-deadline-first non-preemptive scheduler.
+ *
+ * Replaces the GEDF_NP scheduler of the generated runtime with one that keeps
+ * the global mutex off the path of every reaction. Reactions of a level are
+ * released together into an array sorted by deadline. Each released reaction
+ * comes with one permit on the native semaphore (lf_semaphore_t), so a worker
+ * takes a permit and then claims the next reaction of the array with one
+ * atomic increment. Idle workers block on the semaphore, which on XMOS is a
+ * chanend, and use no issue slots.
+ *
+ * The worker that completes the last reaction of a level takes the mutex to
+ * release the next level, advancing the tag if the current one is complete.
+ * Reactions triggered for later levels are queued under the mutex, ordered by
+ * level and then by deadline.
+ *
+ * Idle workers are blocked on the semaphore, so they do not help with
+ * lf_parallel_for(), which runs on the calling worker with this scheduler.
+ */
+
+#ifndef NUMBER_OF_WORKERS
+#define NUMBER_OF_WORKERS 1
+#endif // NUMBER_OF_WORKERS
+
+#include "../lf_platform.h"
+#include "../utils/pqueue.h"
+#include "../utils/pqueue_support.h"
+#include "../utils/util.h"
+#include "scheduler.h"
+#include "scheduler_sync_tag_advance.c"
+
+/////////////////// External Variables /////////////////////////
+extern lf_mutex_t mutex;
+
+/////////////////// Scheduler Variables and Structs /////////////////////////
+// Reactions triggered for a level after the released one.
+static pqueue_t* _lf_sched_q;
+
+// Reactions of the released level, in deadline order.
+static reaction_t** _lf_sched_level = NULL;
+static size_t _lf_sched_level_capacity = 0;
+
+// Index of the next reaction of the released level to hand out.
+static volatile int _lf_sched_next = 0;
+
+// Number of reactions of the released level that are not done yet.
+static volatile int _lf_sched_remaining = 0;
+
+// One permit per released reaction, or one per worker when stopping.
+static lf_semaphore_t* _lf_sched_ready = NULL;
+
+static size_t _lf_sched_number_of_workers = 1;
+
+// Set by the first worker, which releases the first level.
+static volatile bool _lf_sched_started = false;
+static volatile bool _lf_sched_should_stop = false;
+
+/////////////////// Scheduler Private API /////////////////////////
+/**
+ * Priority of a reaction on the queue. The level is put in the most
+ * significant bits so that the queue is ordered by level first, and
+ * the (inferred) deadline carried in the upper bits of the index second.
+ */
+static pqueue_pri_t _lf_sched_get_priority(void* reaction) {
+    index_t index = ((reaction_t*) reaction)->index;
+    return (LEVEL(index) << 48) | (index >> 16);
+}
+
+/**
+ * Release the reactions of the lowest queued level, advancing the tag until
+ * there is one. Release one permit per worker instead if execution stops.
+ * This assumes the mutex is held and that no reaction is executing.
+ */
+static void _lf_sched_release_next_level_locked() {
+    reaction_t* head;
+    while ((head = (reaction_t*) pqueue_peek(_lf_sched_q)) == NULL) {
+        if (_lf_sched_advance_tag_locked()) {
+            _lf_sched_should_stop = true;
+            lf_semaphore_release(_lf_sched_ready, (int) _lf_sched_number_of_workers);
+            return;
+        }
+    }
+    size_t level = LEVEL(head->index);
+    int size = 0;
+    while ((head = (reaction_t*) pqueue_peek(_lf_sched_q)) != NULL && LEVEL(head->index) == level) {
+        if ((size_t) size == _lf_sched_level_capacity) {
+            _lf_sched_level_capacity = _lf_sched_level_capacity ? 2 * _lf_sched_level_capacity : 8;
+            _lf_sched_level = (reaction_t**) realloc(_lf_sched_level,
+                    _lf_sched_level_capacity * sizeof(reaction_t*));
+            if (_lf_sched_level == NULL) {
+                lf_print_error_and_exit("Scheduler: Out of memory.");
+            }
+        }
+        _lf_sched_level[size++] = (reaction_t*) pqueue_pop(_lf_sched_q);
+    }
+    LF_PRINT_DEBUG("Scheduler: Releasing %d reactions of level %zu.", size, level);
+    _lf_sched_next = 0;
+    _lf_sched_remaining = size;
+    lf_semaphore_release(_lf_sched_ready, size);
+}
+
+///////////////////// Scheduler Init and Destroy API /////////////////////////
+/**
+ * @brief Initialize the scheduler.
+ *
+ * This has to be called before other functions of the scheduler can be used.
+ * The mutex is expected to be held by the caller.
+ *
+ * @param number_of_workers Indicate how many workers this scheduler will be
+ *  managing.
+ * @param parameters Unused by this scheduler.
+ */
+void lf_sched_init(size_t number_of_workers, sched_params_t* parameters) {
+    LF_PRINT_DEBUG("Scheduler: Initializing with %zu workers.", number_of_workers);
+    _lf_sched_number_of_workers = number_of_workers;
+    _lf_sched_q = pqueue_init(INITIAL_REACT_QUEUE_SIZE, in_reverse_order, _lf_sched_get_priority,
+            get_reaction_position, set_reaction_position, reaction_matches, print_reaction);
+    _lf_sched_ready = lf_semaphore_new(0);
+    if (_lf_sched_ready == NULL) {
+        lf_print_error_and_exit("Scheduler: Could not create the semaphore.");
+    }
+}
+
+/**
+ * @brief Free the memory used by the scheduler.
+ *
+ * This must be called when the scheduler is no longer needed.
+ */
+void lf_sched_free() {
+    pqueue_free(_lf_sched_q);
+    free(_lf_sched_level);
+    lf_semaphore_destroy(_lf_sched_ready);
+}
+
+///////////////////// Scheduler Worker API (public) /////////////////////////
+/**
+ * @brief Ask the scheduler for one more reaction.
+ *
+ * This function blocks until it can return a ready reaction for the worker,
+ * or NULL if execution should stop.
+ *
+ * @param worker_number The worker number of the worker thread asking for work
+ * to be assigned to it.
+ * @return reaction_t* A reaction for the worker to execute. NULL if the calling
+ * worker thread should exit.
+ */
+reaction_t* lf_sched_get_ready_reaction(int worker_number) {
+    if (!_lf_sched_started && lf_bool_compare_and_swap(&_lf_sched_started, false, true)) {
+        lf_mutex_lock(&mutex);
+        _lf_sched_release_next_level_locked();
+        lf_mutex_unlock(&mutex);
+    }
+    LF_PRINT_DEBUG("Scheduler: Worker %d is waiting for work.", worker_number);
+    lf_semaphore_acquire(_lf_sched_ready);
+    if (_lf_sched_should_stop) {
+        return NULL;
+    }
+    // The permit guarantees that there is a reaction left to claim.
+    return _lf_sched_level[lf_atomic_fetch_add(&_lf_sched_next, 1)];
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' is done
+ * executing the 'done_reaction'.
+ *
+ * @param worker_number The worker number for the worker thread that has
+ * finished executing 'done_reaction'.
+ * @param done_reaction The reaction that is done.
+ */
+void lf_sched_done_with_reaction(size_t worker_number, reaction_t* done_reaction) {
+    if (lf_val_compare_and_swap(&done_reaction->status, queued, inactive) != queued) {
+        lf_print_error_and_exit("Unexpected reaction status: %d. Expected %d.",
+                done_reaction->status, queued);
+    }
+    if (lf_atomic_add_fetch(&_lf_sched_remaining, -1) == 0) {
+        lf_mutex_lock(&mutex);
+        _lf_sched_release_next_level_locked();
+        lf_mutex_unlock(&mutex);
+    }
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' would like to
+ * trigger 'reaction' at the current tag.
+ *
+ * If a reaction is already queued at the current tag, it is not queued again.
+ *
+ * @param reaction The reaction to trigger at the current tag.
+ * @param worker_number The ID of the worker that is making this call. 0 should
+ * be used if there is only one worker (e.g., when the program is using the
+ * unthreaded C runtime). -1 is used for an anonymous call in a context where a
+ * worker number does not make sense (e.g., the caller is not a worker thread).
+ */
+void lf_sched_trigger_reaction(reaction_t* reaction, int worker_number) {
+    if (reaction == NULL
+            || lf_val_compare_and_swap(&reaction->status, inactive, queued) != inactive) {
+        return;
+    }
+    LF_PRINT_DEBUG("Scheduler: Enqueing reaction %s, which has level %lld.",
+            reaction->name, LEVEL(reaction->index));
+    lf_mutex_lock(&mutex);
+    pqueue_insert(_lf_sched_q, reaction);
+    lf_mutex_unlock(&mutex);
+}
@@ -0,0 +1,131 @@
+/**
+ * Scheduler for programs with a single worker.
+ *
+ * Only the worker executes reactions and, while it holds the mutex to advance
+ * the tag, triggers the reactions of the next tag. The reaction queue and the
+ * status of reactions therefore need no lock and no atomic operation. The
+ * global mutex is only taken to advance the tag, which is also where physical
+ * actions and other asynchronous events come in.
+ *
+ * Reactions are executed in the order of their index, that is by (inferred)
+ * deadline and then by level, like in the unthreaded runtime.
+ *
+ * The build script selects this scheduler when the program has one worker
+ * and no other scheduler is forced with LF_XMOS_SCHEDULER.
+ */
+
+#ifndef NUMBER_OF_WORKERS
+#define NUMBER_OF_WORKERS 1
+#endif // NUMBER_OF_WORKERS
+
+#if NUMBER_OF_WORKERS != 1
+#error "The SINGLE scheduler needs exactly one worker."
+#endif
+
+#include "../lf_platform.h"
+#include "../utils/pqueue.h"
+#include "../utils/pqueue_support.h"
+#include "../utils/util.h"
+#include "scheduler.h"
+#include "scheduler_sync_tag_advance.c"
+
+/////////////////// External Variables /////////////////////////
+extern lf_mutex_t mutex;
+
+/////////////////// Scheduler Variables and Structs /////////////////////////
+// Reactions triggered at the current tag, only used by the worker.
+static pqueue_t* _lf_sched_q;
+
+///////////////////// Scheduler Init and Destroy API /////////////////////////
+/**
+ * @brief Initialize the scheduler.
+ *
+ * This has to be called before other functions of the scheduler can be used.
+ * The mutex is expected to be held by the caller.
+ *
+ * @param number_of_workers Indicate how many workers this scheduler will be
+ *  managing. Must be 1.
+ * @param parameters Unused by this scheduler.
+ */
+void lf_sched_init(size_t number_of_workers, sched_params_t* parameters) {
+    LF_PRINT_DEBUG("Scheduler: Initializing with %zu workers.", number_of_workers);
+    if (number_of_workers != 1) {
+        lf_print_error_and_exit("Scheduler: The SINGLE scheduler needs exactly one worker.");
+    }
+    _lf_sched_q = pqueue_init(INITIAL_REACT_QUEUE_SIZE, in_reverse_order, get_reaction_index,
+            get_reaction_position, set_reaction_position, reaction_matches, print_reaction);
+}
+
+/**
+ * @brief Free the memory used by the scheduler.
+ *
+ * This must be called when the scheduler is no longer needed.
+ */
+void lf_sched_free() {
+    pqueue_free(_lf_sched_q);
+}
+
+///////////////////// Scheduler Worker API (public) /////////////////////////
+/**
+ * @brief Ask the scheduler for one more reaction.
+ *
+ * Advances the tag when the current one is complete. This function blocks
+ * until it can return a ready reaction, or NULL if execution should stop.
+ *
+ * @param worker_number The worker number of the worker thread asking for work
+ * to be assigned to it.
+ * @return reaction_t* A reaction for the worker to execute. NULL if the calling
+ * worker thread should exit.
+ */
+reaction_t* lf_sched_get_ready_reaction(int worker_number) {
+    reaction_t* reaction;
+    while ((reaction = (reaction_t*) pqueue_pop(_lf_sched_q)) == NULL) {
+        lf_mutex_lock(&mutex);
+        bool stop = _lf_sched_advance_tag_locked();
+        lf_mutex_unlock(&mutex);
+        if (stop) {
+            return NULL;
+        }
+    }
+    return reaction;
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' is done
+ * executing the 'done_reaction'.
+ *
+ * @param worker_number The worker number for the worker thread that has
+ * finished executing 'done_reaction'.
+ * @param done_reaction The reaction that is done.
+ */
+void lf_sched_done_with_reaction(size_t worker_number, reaction_t* done_reaction) {
+    if (done_reaction->status != queued) {
+        lf_print_error_and_exit("Unexpected reaction status: %d. Expected %d.",
+                done_reaction->status, queued);
+    }
+    done_reaction->status = inactive;
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' would like to
+ * trigger 'reaction' at the current tag.
+ *
+ * If a reaction is already queued at the current tag, it is not queued again.
+ * This is called by the worker, or with the mutex held before the worker
+ * starts.
+ *
+ * @param reaction The reaction to trigger at the current tag.
+ * @param worker_number The ID of the worker that is making this call. 0 should
+ * be used if there is only one worker (e.g., when the program is using the
+ * unthreaded C runtime). -1 is used for an anonymous call in a context where a
+ * worker number does not make sense (e.g., the caller is not a worker thread).
+ */
+void lf_sched_trigger_reaction(reaction_t* reaction, int worker_number) {
+    if (reaction == NULL || reaction->status != inactive) {
+        return;
+    }
+    LF_PRINT_DEBUG("Scheduler: Enqueing reaction %s, which has level %lld.",
+            reaction->name, LEVEL(reaction->index));
+    reaction->status = queued;
+    pqueue_insert(_lf_sched_q, reaction);
+}
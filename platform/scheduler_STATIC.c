@@ -0,0 +1,298 @@
+/**
+ * Static partitioning scheduler.
+ *
+ * Every reaction is executed by one fixed worker. The owner of a reaction is:
+ *  1. the worker its reactor was pinned to with lf_sched_static_pin_reactor(),
+ *     e.g. by a reactor that owns an I/O port, or otherwise
+ *  2. derived from the lowest bit of its chain ID, so that the reactions of
+ *     an independent chain stay on the same hardware thread.
+ *
+ * Each worker only runs reactions from its own ready queue. Dependencies
+ * among the reactions of a tag are counted (see scheduler_dependencies.c),
+ * and when the last predecessor of a reaction completes, only the owner of
+ * that reaction is woken, through its own chanend. The scheduler state is
+ * protected by a scheduler lock. The global mutex is only taken to advance
+ * the tag.
+ *
+ * Compile definitions:
+ *  - LF_STATIC_MAX_PINS: Maximum number of pinned reactors (default 16).
+ */
+
+#ifndef NUMBER_OF_WORKERS
+#define NUMBER_OF_WORKERS 1
+#endif // NUMBER_OF_WORKERS
+
+#include "../lf_platform.h"
+#include "../utils/pqueue.h"
+#include "../utils/pqueue_support.h"
+#include "../utils/util.h"
+#include "scheduler.h"
+#include "scheduler_dependencies.c"
+#include "scheduler_sync_tag_advance.c"
+
+#include <xcore/assert.h>
+
+#ifndef LF_STATIC_MAX_PINS
+#define LF_STATIC_MAX_PINS 16
+#endif
+
+/////////////////// External Variables /////////////////////////
+extern lf_mutex_t mutex;
+
+/////////////////// Scheduler Variables and Structs /////////////////////////
+typedef struct {
+    // Reactions owned by this worker whose predecessors have completed.
+    pqueue_t* ready_q;
+    // Chanend on which the worker waits while it has nothing to do.
+    chanend_t wake;
+    bool sleeping;
+} _lf_sched_worker_t;
+
+typedef struct {
+    void* self;
+    int worker_number;
+} _lf_sched_pin_t;
+
+static _lf_sched_worker_t _lf_sched_workers[NUMBER_OF_WORKERS];
+static size_t _lf_sched_number_of_workers = 1;
+
+// Protects all scheduler state below, including the dependency counts.
+static lf_mutex_t _lf_sched_lock;
+
+// Chanend used to wake workers. Only used while holding the scheduler lock.
+static chanend_t _lf_sched_signal_chan;
+
+static _lf_sched_pin_t _lf_sched_pins[LF_STATIC_MAX_PINS];
+static size_t _lf_sched_number_of_pins = 0;
+
+static bool _lf_sched_advancing = false;
+static bool _lf_sched_should_stop = false;
+
+/////////////////// Scheduler Private API /////////////////////////
+/**
+ * Return the worker that owns 'reaction'.
+ * This assumes the scheduler lock is held.
+ */
+static int _lf_sched_owner_locked(reaction_t* reaction) {
+    for (size_t i = 0; i < _lf_sched_number_of_pins; i++) {
+        if (_lf_sched_pins[i].self == reaction->self) {
+            return _lf_sched_pins[i].worker_number;
+        }
+    }
+    if (reaction->chain_id == 0) {
+        return 0;
+    }
+    return __builtin_ctzll(reaction->chain_id) % _lf_sched_number_of_workers;
+}
+
+/**
+ * Wake up a worker if it is sleeping.
+ * This assumes the scheduler lock is held.
+ */
+static void _lf_sched_wake_locked(int worker_number) {
+    _lf_sched_worker_t* worker = &_lf_sched_workers[worker_number];
+    if (worker->sleeping) {
+        worker->sleeping = false;
+        chanend_set_dest(_lf_sched_signal_chan, worker->wake);
+        chanend_out_control_token(_lf_sched_signal_chan, 0x1);
+    }
+}
+
+static void _lf_sched_wake_all_locked() {
+    for (size_t i = 0; i < _lf_sched_number_of_workers; i++) {
+        _lf_sched_wake_locked(i);
+    }
+}
+
+/**
+ * Put a reaction whose predecessors have completed on its owner's queue.
+ * This assumes the scheduler lock is held.
+ */
+static void _lf_sched_release_locked(reaction_t* reaction) {
+    int owner = _lf_sched_owner_locked(reaction);
+    LF_PRINT_DEBUG("Scheduler: Releasing reaction %s to worker %d.", reaction->name, owner);
+    pqueue_insert(_lf_sched_workers[owner].ready_q, reaction);
+    _lf_sched_wake_locked(owner);
+}
+
+/**
+ * Advance the tag while holding the global mutex.
+ * This assumes the scheduler lock is held. It is released while advancing.
+ */
+static void _lf_sched_advance_locked() {
+    _lf_sched_advancing = true;
+    // Reactions triggered while advancing are only released once the tag
+    // advance has finished. Until then, _lf_pop_events() may still be
+    // setting the tokens and is_present fields of the new tag, and a later
+    // event may trigger a predecessor, see scheduler_dependencies.c.
+    _lf_dep_hold_locked();
+    lf_mutex_unlock(&_lf_sched_lock);
+
+    lf_mutex_lock(&mutex);
+    bool stop = _lf_sched_advance_tag_locked();
+    lf_mutex_unlock(&mutex);
+
+    lf_mutex_lock(&_lf_sched_lock);
+    _lf_dep_release_held_locked(_lf_sched_release_locked);
+    _lf_sched_advancing = false;
+    if (stop) {
+        _lf_sched_should_stop = true;
+        _lf_sched_wake_all_locked();
+    }
+}
+
+///////////////////// Scheduler Init and Destroy API /////////////////////////
+/**
+ * @brief Initialize the scheduler.
+ *
+ * This has to be called before other functions of the scheduler can be used.
+ * The mutex is expected to be held by the caller.
+ *
+ * @param number_of_workers Indicate how many workers this scheduler will be
+ *  managing.
+ * @param parameters Unused by this scheduler.
+ */
+void lf_sched_init(size_t number_of_workers, sched_params_t* parameters) {
+    LF_PRINT_DEBUG("Scheduler: Initializing with %zu workers.", number_of_workers);
+    xassert(number_of_workers <= NUMBER_OF_WORKERS);
+    _lf_sched_number_of_workers = number_of_workers;
+    lf_mutex_init(&_lf_sched_lock);
+    _lf_sched_signal_chan = chanend_alloc();
+    xassert(_lf_sched_signal_chan);
+    for (size_t i = 0; i < number_of_workers; i++) {
+        _lf_sched_workers[i].ready_q = pqueue_init(INITIAL_REACT_QUEUE_SIZE, in_reverse_order, get_reaction_index,
+                get_reaction_position, set_reaction_position, reaction_matches, print_reaction);
+        _lf_sched_workers[i].wake = chanend_alloc();
+        xassert(_lf_sched_workers[i].wake);
+        _lf_sched_workers[i].sleeping = false;
+    }
+    _lf_dep_init(INITIAL_REACT_QUEUE_SIZE);
+}
+
+/**
+ * @brief Free the memory used by the scheduler.
+ *
+ * This must be called when the scheduler is no longer needed.
+ */
+void lf_sched_free() {
+    for (size_t i = 0; i < _lf_sched_number_of_workers; i++) {
+        pqueue_free(_lf_sched_workers[i].ready_q);
+        chanend_free(_lf_sched_workers[i].wake);
+    }
+    chanend_free(_lf_sched_signal_chan);
+    lf_xmos_mutex_free(&_lf_sched_lock);
+    _lf_dep_free();
+}
+
+/**
+ * @brief Pin all reactions of a reactor to a worker.
+ *
+ * A reactor that owns an I/O port can call this from its startup reaction so
+ * that all of its port accesses are made by the same hardware thread. The pin
+ * applies to reactions released after the call, which includes the later
+ * reactions of the reactor at the same tag, but not the calling reaction. It
+ * runs unpinned, so it should not access the port itself (see
+ * src/PreciseIO.lf).
+ *
+ * @param self The self struct of the reactor.
+ * @param worker_number The worker that executes the reactions of the reactor.
+ */
+void lf_sched_static_pin_reactor(void* self, int worker_number) {
+    lf_mutex_lock(&_lf_sched_lock);
+    xassert(_lf_sched_number_of_pins < LF_STATIC_MAX_PINS);
+    _lf_sched_pins[_lf_sched_number_of_pins].self = self;
+    _lf_sched_pins[_lf_sched_number_of_pins].worker_number = worker_number % _lf_sched_number_of_workers;
+    _lf_sched_number_of_pins++;
+    lf_mutex_unlock(&_lf_sched_lock);
+}
+
+///////////////////// Scheduler Worker API (public) /////////////////////////
+/**
+ * @brief Ask the scheduler for one more reaction.
+ *
+ * Only reactions owned by 'worker_number' are returned. This function blocks
+ * until one is ready, or returns NULL if execution should stop. The worker
+ * that finds no reaction in flight advances the tag.
+ *
+ * @param worker_number The worker number of the worker thread asking for work
+ * to be assigned to it.
+ * @return reaction_t* A reaction for the worker to execute. NULL if the calling
+ * worker thread should exit.
+ */
+reaction_t* lf_sched_get_ready_reaction(int worker_number) {
+    _lf_sched_worker_t* worker = &_lf_sched_workers[worker_number];
+    lf_mutex_lock(&_lf_sched_lock);
+    while (!_lf_sched_should_stop) {
+        if (_lf_dep_held() && !_lf_sched_advancing) {
+            // The startup reactions have been triggered before the workers
+            // started.
+            _lf_dep_release_held_locked(_lf_sched_release_locked);
+        }
+        reaction_t* reaction = (reaction_t*) pqueue_pop(worker->ready_q);
+        if (reaction != NULL) {
+            lf_mutex_unlock(&_lf_sched_lock);
+            return reaction;
+        }
+        if (_lf_dep_in_flight_count() == 0 && !_lf_sched_advancing) {
+            _lf_sched_advance_locked();
+            continue;
+        }
+        LF_PRINT_DEBUG("Scheduler: Worker %d is waiting for work.", worker_number);
+        worker->sleeping = true;
+        lf_mutex_unlock(&_lf_sched_lock);
+        char token = chanend_in_control_token(worker->wake);
+        xassert(token == 0x1);
+        lf_mutex_lock(&_lf_sched_lock);
+    }
+    lf_mutex_unlock(&_lf_sched_lock);
+    return NULL;
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' is done
+ * executing the 'done_reaction'.
+ *
+ * The owners of successors that become ready are woken up. If this was the
+ * last reaction of the tag, the calling worker advances the tag the next time
+ * it asks for work.
+ *
+ * @param worker_number The worker number for the worker thread that has
+ * finished executing 'done_reaction'.
+ * @param done_reaction The reaction that is done.
+ */
+void lf_sched_done_with_reaction(size_t worker_number, reaction_t* done_reaction) {
+    lf_mutex_lock(&_lf_sched_lock);
+    if (done_reaction->status != queued) {
+        lf_print_error_and_exit("Unexpected reaction status: %d. Expected %d.",
+                done_reaction->status, queued);
+    }
+    done_reaction->status = inactive;
+    _lf_dep_remove_locked(done_reaction, _lf_sched_release_locked);
+    lf_mutex_unlock(&_lf_sched_lock);
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' would like to
+ * trigger 'reaction' at the current tag.
+ *
+ * If a reaction is already queued at the current tag, it is not queued again.
+ *
+ * @param reaction The reaction to trigger at the current tag.
+ * @param worker_number The ID of the worker that is making this call. 0 should
+ * be used if there is only one worker (e.g., when the program is using the
+ * unthreaded C runtime). -1 is used for an anonymous call in a context where a
+ * worker number does not make sense (e.g., the caller is not a worker thread).
+ */
+void lf_sched_trigger_reaction(reaction_t* reaction, int worker_number) {
+    if (reaction == NULL) {
+        return;
+    }
+    lf_mutex_lock(&_lf_sched_lock);
+    if (reaction->status == inactive) {
+        reaction->status = queued;
+        if (_lf_dep_add_locked(reaction)) {
+            _lf_sched_release_locked(reaction);
+        }
+    }
+    lf_mutex_unlock(&_lf_sched_lock);
+}
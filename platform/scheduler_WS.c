@@ -0,0 +1,351 @@
+/**
+ * Work-stealing scheduler with per-worker ready deques.
+ *
+ * Each worker owns a deque holding reactions of the current level and a
+ * private queue of reactions it triggered for later levels. Reactions that a
+ * worker triggers stay with that worker, so the common case of a reaction
+ * enabling its own successors touches no shared state. A worker that runs out
+ * of work steals from the top of the other workers' deques.
+ *
+ * Deques are only filled at the level barrier, when all workers are idle. At
+ * that point the last worker to arrive moves the reactions of the next level
+ * from every private queue into the owner's deque and spreads reactions that
+ * were triggered outside of a worker (e.g. by _lf_pop_events) over the deques.
+ * Within a level, deques only shrink. The owner pops from the bottom without
+ * locking; only the race for the last element and steals use a compare and
+ * swap on the top index (Chase-Lev).
+ *
+ * Workers meet at the level barrier on an lf_barrier_t without taking the
+ * global mutex. Only the last worker to arrive locks it to release the next
+ * level or to advance the tag.
+ */
+
+#ifndef NUMBER_OF_WORKERS
+#define NUMBER_OF_WORKERS 1
+#endif // NUMBER_OF_WORKERS
+
+#include "../lf_platform.h"
+#include "../platform/lf_parallel_for.h"
+#include "../utils/pqueue.h"
+#include "../utils/pqueue_support.h"
+#include "../utils/util.h"
+#include "scheduler.h"
+#include "scheduler_sync_tag_advance.c"
+
+/////////////////// External Variables /////////////////////////
+extern lf_mutex_t mutex;
+
+/////////////////// Scheduler Variables and Structs /////////////////////////
+typedef struct {
+    reaction_t** buffer;
+    int capacity;
+    // Index of the next reaction to steal. Advanced with compare and swap.
+    volatile int top;
+    // Index one past the last reaction. Only written by the owner and by the
+    // worker distributing reactions at the level barrier.
+    volatile int bottom;
+    // Reactions triggered by the owner for later levels.
+    pqueue_t* deferred;
+} _lf_sched_deque_t;
+
+static _lf_sched_deque_t* _lf_sched_deques;
+
+// Reactions triggered by something other than a worker.
+static pqueue_t* _lf_sched_global_q;
+
+// Barrier at which idle workers wait for the next level.
+static lf_barrier_t _lf_sched_level_barrier;
+
+static size_t _lf_sched_number_of_workers = 1;
+
+static volatile bool _lf_sched_should_stop = false;
+
+/////////////////// Scheduler Private API /////////////////////////
+/**
+ * Push a reaction on a deque. Only used at the level barrier, when no worker
+ * is popping or stealing.
+ */
+static void _lf_sched_deque_push(_lf_sched_deque_t* deque, reaction_t* reaction) {
+    if (deque->bottom == deque->capacity) {
+        deque->capacity *= 2;
+        deque->buffer = (reaction_t**) realloc(deque->buffer, sizeof(reaction_t*) * deque->capacity);
+        if (deque->buffer == NULL) {
+            lf_print_error_and_exit("Scheduler: Out of memory.");
+        }
+    }
+    deque->buffer[deque->bottom] = reaction;
+    deque->bottom = deque->bottom + 1;
+}
+
+/**
+ * Pop a reaction from the bottom of the deque of the calling worker.
+ * XCore threads on a tile see memory accesses in program order, so no fence
+ * is needed between publishing 'bottom' and reading 'top'.
+ */
+static reaction_t* _lf_sched_deque_pop(_lf_sched_deque_t* deque) {
+    int b = deque->bottom - 1;
+    deque->bottom = b;
+    int t = deque->top;
+    if (t > b) {
+        // Empty.
+        deque->bottom = b + 1;
+        return NULL;
+    }
+    reaction_t* reaction = deque->buffer[b];
+    if (t == b) {
+        // Last reaction. Race with the thieves for it.
+        if (lf_val_compare_and_swap(&deque->top, t, t + 1) != t) {
+            reaction = NULL;
+        }
+        deque->bottom = b + 1;
+    }
+    return reaction;
+}
+
+/**
+ * Steal a reaction from the top of another worker's deque.
+ * @return The stolen reaction or NULL if the deque is empty or the race was lost.
+ */
+static reaction_t* _lf_sched_deque_steal(_lf_sched_deque_t* deque) {
+    int t = deque->top;
+    int b = deque->bottom;
+    if (t >= b) {
+        return NULL;
+    }
+    reaction_t* reaction = deque->buffer[t];
+    if (lf_val_compare_and_swap(&deque->top, t, t + 1) != t) {
+        return NULL;
+    }
+    return reaction;
+}
+
+/**
+ * Get work for 'worker_number', first from its own deque, then by stealing.
+ */
+static reaction_t* _lf_sched_find_work(int worker_number) {
+    reaction_t* reaction = _lf_sched_deque_pop(&_lf_sched_deques[worker_number]);
+    for (size_t i = 1; reaction == NULL && i < _lf_sched_number_of_workers; i++) {
+        size_t victim = (worker_number + i) % _lf_sched_number_of_workers;
+        reaction = _lf_sched_deque_steal(&_lf_sched_deques[victim]);
+    }
+    return reaction;
+}
+
+static bool _lf_sched_any_work() {
+    for (size_t i = 0; i < _lf_sched_number_of_workers; i++) {
+        if (_lf_sched_deques[i].top < _lf_sched_deques[i].bottom) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Return the lowest level among the deferred reactions.
+ * This assumes the mutex is held and all workers are idle.
+ * @return true if a reaction was found.
+ */
+static bool _lf_sched_lowest_level_locked(size_t* level) {
+    bool found = false;
+    reaction_t* head = (reaction_t*) pqueue_peek(_lf_sched_global_q);
+    if (head != NULL) {
+        *level = LEVEL(head->index);
+        found = true;
+    }
+    for (size_t i = 0; i < _lf_sched_number_of_workers; i++) {
+        head = (reaction_t*) pqueue_peek(_lf_sched_deques[i].deferred);
+        if (head != NULL && (!found || LEVEL(head->index) < *level)) {
+            *level = LEVEL(head->index);
+            found = true;
+        }
+    }
+    return found;
+}
+
+/**
+ * Fill the deques with the reactions of 'level'.
+ * This assumes the mutex is held and all workers are idle.
+ */
+static void _lf_sched_distribute_locked(size_t level) {
+    for (size_t i = 0; i < _lf_sched_number_of_workers; i++) {
+        _lf_sched_deque_t* deque = &_lf_sched_deques[i];
+        deque->top = 0;
+        deque->bottom = 0;
+        reaction_t* head;
+        while ((head = (reaction_t*) pqueue_peek(deque->deferred)) != NULL
+                && LEVEL(head->index) == level) {
+            _lf_sched_deque_push(deque, (reaction_t*) pqueue_pop(deque->deferred));
+        }
+    }
+    reaction_t* head;
+    size_t next = 0;
+    while ((head = (reaction_t*) pqueue_peek(_lf_sched_global_q)) != NULL
+            && LEVEL(head->index) == level) {
+        _lf_sched_deque_push(&_lf_sched_deques[next], (reaction_t*) pqueue_pop(_lf_sched_global_q));
+        next = (next + 1) % _lf_sched_number_of_workers;
+    }
+}
+
+/**
+ * Release the next level, advancing the tag if the current one is complete.
+ * This assumes the mutex is held and all workers are idle.
+ */
+static void _lf_sched_release_next_level_locked() {
+    size_t level;
+    while (!_lf_sched_lowest_level_locked(&level)) {
+        if (_lf_sched_advance_tag_locked()) {
+            _lf_sched_should_stop = true;
+            return;
+        }
+    }
+    _lf_sched_distribute_locked(level);
+}
+
+/**
+ * Wake the workers waiting at the level barrier so that they help with a
+ * parallel loop. This assumes the mutex is held.
+ */
+static void _lf_sched_wake_all_locked() {
+    lf_barrier_wake(&_lf_sched_level_barrier);
+}
+
+/**
+ * Wait at the level barrier. The last worker to arrive releases the next level.
+ * @return false if the worker should stop.
+ */
+static bool _lf_sched_wait_for_level(int worker_number) {
+    if (_lf_sched_any_work()) {
+        // A steal was lost while work remained.
+        return true;
+    }
+    int sense;
+    if (lf_barrier_arrive(&_lf_sched_level_barrier, &sense)) {
+        lf_mutex_lock(&mutex);
+        _lf_sched_release_next_level_locked();
+        lf_mutex_unlock(&mutex);
+        lf_barrier_release(&_lf_sched_level_barrier);
+    } else {
+        LF_PRINT_DEBUG("Scheduler: Worker %d is waiting for the next level.", worker_number);
+        while (!lf_barrier_wait(&_lf_sched_level_barrier, sense)) {
+            // Woken up for a parallel loop.
+            lf_mutex_lock(&mutex);
+            lf_parallel_for_help();
+            lf_mutex_unlock(&mutex);
+        }
+    }
+    return !_lf_sched_should_stop;
+}
+
+///////////////////// Scheduler Init and Destroy API /////////////////////////
+/**
+ * @brief Initialize the scheduler.
+ *
+ * This has to be called before other functions of the scheduler can be used.
+ * The mutex is expected to be held by the caller.
+ *
+ * @param number_of_workers Indicate how many workers this scheduler will be
+ *  managing.
+ * @param parameters Unused by this scheduler.
+ */
+void lf_sched_init(size_t number_of_workers, sched_params_t* parameters) {
+    LF_PRINT_DEBUG("Scheduler: Initializing with %zu workers.", number_of_workers);
+    _lf_sched_number_of_workers = number_of_workers;
+    _lf_sched_deques = (_lf_sched_deque_t*) calloc(number_of_workers, sizeof(_lf_sched_deque_t));
+    if (_lf_sched_deques == NULL) {
+        lf_print_error_and_exit("Scheduler: Out of memory.");
+    }
+    for (size_t i = 0; i < number_of_workers; i++) {
+        _lf_sched_deques[i].capacity = INITIAL_REACT_QUEUE_SIZE;
+        _lf_sched_deques[i].buffer = (reaction_t**) malloc(sizeof(reaction_t*) * INITIAL_REACT_QUEUE_SIZE);
+        _lf_sched_deques[i].deferred = pqueue_init(INITIAL_REACT_QUEUE_SIZE, in_reverse_order, get_reaction_index,
+                get_reaction_position, set_reaction_position, reaction_matches, print_reaction);
+        if (_lf_sched_deques[i].buffer == NULL) {
+            lf_print_error_and_exit("Scheduler: Out of memory.");
+        }
+    }
+    _lf_sched_global_q = pqueue_init(INITIAL_REACT_QUEUE_SIZE, in_reverse_order, get_reaction_index,
+            get_reaction_position, set_reaction_position, reaction_matches, print_reaction);
+    if (lf_barrier_init(&_lf_sched_level_barrier, (int) number_of_workers) != 0) {
+        lf_print_error_and_exit("Scheduler: Could not initialize the level barrier.");
+    }
+    lf_parallel_for_init(_lf_sched_wake_all_locked);
+}
+
+/**
+ * @brief Free the memory used by the scheduler.
+ *
+ * This must be called when the scheduler is no longer needed.
+ */
+void lf_sched_free() {
+    for (size_t i = 0; i < _lf_sched_number_of_workers; i++) {
+        free(_lf_sched_deques[i].buffer);
+        pqueue_free(_lf_sched_deques[i].deferred);
+    }
+    free(_lf_sched_deques);
+    pqueue_free(_lf_sched_global_q);
+    lf_barrier_free(&_lf_sched_level_barrier);
+}
+
+///////////////////// Scheduler Worker API (public) /////////////////////////
+/**
+ * @brief Ask the scheduler for one more reaction.
+ *
+ * This function blocks until it can return a ready reaction for the worker,
+ * or NULL if execution should stop.
+ *
+ * @param worker_number The worker number of the worker thread asking for work
+ * to be assigned to it.
+ * @return reaction_t* A reaction for the worker to execute. NULL if the calling
+ * worker thread should exit.
+ */
+reaction_t* lf_sched_get_ready_reaction(int worker_number) {
+    do {
+        reaction_t* reaction = _lf_sched_find_work(worker_number);
+        if (reaction != NULL) {
+            return reaction;
+        }
+    } while (_lf_sched_wait_for_level(worker_number));
+    return NULL;
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' is done
+ * executing the 'done_reaction'.
+ *
+ * @param worker_number The worker number for the worker thread that has
+ * finished executing 'done_reaction'.
+ * @param done_reaction The reaction that is done.
+ */
+void lf_sched_done_with_reaction(size_t worker_number, reaction_t* done_reaction) {
+    if (lf_val_compare_and_swap(&done_reaction->status, queued, inactive) != queued) {
+        lf_print_error_and_exit("Unexpected reaction status: %d. Expected %d.",
+                done_reaction->status, queued);
+    }
+}
+
+/**
+ * @brief Inform the scheduler that worker thread 'worker_number' would like to
+ * trigger 'reaction' at the current tag.
+ *
+ * Reactions triggered by a worker are kept by that worker. Others go to a
+ * shared queue that is distributed at the next level barrier.
+ *
+ * @param reaction The reaction to trigger at the current tag.
+ * @param worker_number The ID of the worker that is making this call. 0 should
+ * be used if there is only one worker (e.g., when the program is using the
+ * unthreaded C runtime). -1 is used for an anonymous call in a context where a
+ * worker number does not make sense (e.g., the caller is not a worker thread).
+ */
+void lf_sched_trigger_reaction(reaction_t* reaction, int worker_number) {
+    if (reaction == NULL
+            || lf_val_compare_and_swap(&reaction->status, inactive, queued) != inactive) {
+        return;
+    }
+    if (worker_number >= 0) {
+        pqueue_insert(_lf_sched_deques[worker_number].deferred, reaction);
+    } else {
+        lf_mutex_lock(&mutex);
+        pqueue_insert(_lf_sched_global_q, reaction);
+        lf_mutex_unlock(&mutex);
+    }
+}
@@ -0,0 +1,160 @@
+/**
+ * Dependency counting among the reactions triggered at the current tag.
+ *
+ * Every triggered reaction that has not completed yet is kept in an in-flight
+ * table together with the number of in-flight reactions it has to wait for.
+ * A reaction waits for another one if the other one has a lower level and
+ * their chain IDs overlap. Since the chain ID of a reaction covers the chains
+ * of everything downstream of it, this never misses a real dependency, but
+ * it may add a few that only exist through a common upstream reaction.
+ *
+ * A reaction only gains predecessors until it is released. The events of a
+ * tag trigger reactions in event order, not level order, so a reaction
+ * triggered early could otherwise be released before a predecessor triggered
+ * later at the same tag is added. Releases are therefore held while a tag is
+ * advanced (_lf_dep_hold_locked()) and made once every reaction triggered by
+ * the events of the tag has been added (_lf_dep_release_held_locked()).
+ * Reactions triggered later in the tag are downstream of an in-flight
+ * reaction, so whatever they precede is not released yet.
+ *
+ * The functions here assume that the caller serializes access with a lock.
+ * The table is empty exactly when all reactions of the current tag are done.
+ */
+
+#include "scheduler.h"
+
+typedef struct {
+    reaction_t* reaction;
+    // Number of in-flight reactions that have to complete before 'reaction'.
+    size_t upstream;
+    // Whether 'reaction' was handed to the scheduler to be executed.
+    bool released;
+} _lf_dep_entry_t;
+
+static _lf_dep_entry_t* _lf_dep_in_flight = NULL;
+static size_t _lf_dep_size = 0;
+static size_t _lf_dep_capacity = 0;
+
+// Whether releases are held. The startup reactions are triggered before the
+// workers start, so this starts out true.
+static bool _lf_dep_holding = true;
+
+/**
+ * Return true if 'downstream' has to wait for 'upstream'.
+ * A chain ID of 0 is treated as overlapping all chains.
+ */
+static inline bool _lf_dep_depends_on(reaction_t* downstream, reaction_t* upstream) {
+    if (LEVEL(upstream->index) >= LEVEL(downstream->index)) {
+        return false;
+    }
+    return downstream->chain_id == 0 || upstream->chain_id == 0
+        || (downstream->chain_id & upstream->chain_id) != 0;
+}
+
+static void _lf_dep_init(size_t initial_capacity) {
+    _lf_dep_capacity = initial_capacity;
+    _lf_dep_in_flight = (_lf_dep_entry_t*) malloc(sizeof(_lf_dep_entry_t) * _lf_dep_capacity);
+    if (_lf_dep_in_flight == NULL) {
+        lf_print_error_and_exit("Scheduler: Out of memory.");
+    }
+    _lf_dep_size = 0;
+}
+
+static void _lf_dep_free() {
+    free(_lf_dep_in_flight);
+    _lf_dep_in_flight = NULL;
+    _lf_dep_capacity = 0;
+}
+
+/**
+ * Add a newly triggered reaction to the in-flight table and count its
+ * predecessors. Reactions already in the table that depend on it and have
+ * not been released yet get one more predecessor.
+ * @return true if the reaction has no predecessor and releases are not held.
+ *  The caller then releases it.
+ */
+static bool _lf_dep_add_locked(reaction_t* reaction) {
+    if (_lf_dep_size == _lf_dep_capacity) {
+        _lf_dep_capacity *= 2;
+        _lf_dep_in_flight = (_lf_dep_entry_t*) realloc(_lf_dep_in_flight,
+                sizeof(_lf_dep_entry_t) * _lf_dep_capacity);
+        if (_lf_dep_in_flight == NULL) {
+            lf_print_error_and_exit("Scheduler: Out of memory.");
+        }
+    }
+    size_t upstream = 0;
+    for (size_t i = 0; i < _lf_dep_size; i++) {
+        _lf_dep_entry_t* entry = &_lf_dep_in_flight[i];
+        if (_lf_dep_depends_on(reaction, entry->reaction)) {
+            upstream++;
+        } else if (!entry->released && _lf_dep_depends_on(entry->reaction, reaction)) {
+            entry->upstream++;
+        }
+    }
+    bool release = upstream == 0 && !_lf_dep_holding;
+    _lf_dep_in_flight[_lf_dep_size].reaction = reaction;
+    _lf_dep_in_flight[_lf_dep_size].upstream = upstream;
+    _lf_dep_in_flight[_lf_dep_size].released = release;
+    _lf_dep_size++;
+    return release;
+}
+
+/**
+ * Remove a completed reaction from the in-flight table and call 'release'
+ * for each reaction that has no predecessor left.
+ */
+static void _lf_dep_remove_locked(reaction_t* done, void (*release)(reaction_t*)) {
+    for (size_t i = 0; i < _lf_dep_size; i++) {
+        if (_lf_dep_in_flight[i].reaction == done) {
+            _lf_dep_in_flight[i] = _lf_dep_in_flight[--_lf_dep_size];
+            break;
+        }
+    }
+    for (size_t i = 0; i < _lf_dep_size; i++) {
+        _lf_dep_entry_t* entry = &_lf_dep_in_flight[i];
+        if (!entry->released && _lf_dep_depends_on(entry->reaction, done)) {
+            if (--entry->upstream == 0 && !_lf_dep_holding) {
+                entry->released = true;
+                release(entry->reaction);
+            }
+        }
+    }
+}
+
+/**
+ * Hold releases until _lf_dep_release_held_locked(), e.g. while the tag is
+ * advanced and its events are turned into triggered reactions.
+ */
+static inline void _lf_dep_hold_locked() {
+    _lf_dep_holding = true;
+}
+
+/**
+ * Stop holding releases and call 'release' for each reaction that has no
+ * predecessor.
+ */
+static void _lf_dep_release_held_locked(void (*release)(reaction_t*)) {
+    _lf_dep_holding = false;
+    for (size_t i = 0; i < _lf_dep_size; i++) {
+        _lf_dep_entry_t* entry = &_lf_dep_in_flight[i];
+        if (!entry->released && entry->upstream == 0) {
+            entry->released = true;
+            release(entry->reaction);
+        }
+    }
+}
+
+/**
+ * Return true if releases are held.
+ */
+static inline bool _lf_dep_held() {
+    return _lf_dep_holding;
+}
+
+/**
+ * Return the number of reactions triggered at the current tag that have not
+ * completed yet.
+ */
+static inline size_t _lf_dep_in_flight_count() {
+    return _lf_dep_size;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+/**
+ * Replaces core/utils/semaphore.h of the generated runtime.
+ *
+ * The generated semaphore is built from the global mutex API and condition
+ * variables. This one maps the same API onto the native semaphore of the
+ * platform (lf_semaphore_new() and friends in lf_platform.h), so that
+ * core/utils/semaphore.c is not needed anymore.
+ */
+
+#include "../lf_platform.h"
+
+typedef lf_semaphore_t semaphore_t;
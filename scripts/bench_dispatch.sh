@@ -0,0 +1,23 @@
+#!/usr/bin/env bash
+# Build and run a benchmark program with reactions called through plain
+# function pointers and with LF_XMOS_DIRECT_DISPATCH=1, and print the stack
+# use from the link report and the lines the program reports at shutdown.
+#
+# Usage: scripts/bench_dispatch.sh [src/BenchTagRate.lf]
+
+# Exit on first error
+set -e
+
+LFC=${LFC:-lfc}
+PROGRAM=${1:-src/BenchTagRate.lf}
+NAME=$(basename $PROGRAM .lf)
+PROJECT_ROOT=$(cd $(dirname $0)/.. && pwd)
+
+for DISPATCH in 0 1
+do
+    echo "---- $NAME LF_XMOS_DIRECT_DISPATCH=$DISPATCH"
+    # The report says how much stack each tile needs, with caveats when it
+    # cannot follow an indirect call.
+    LF_XMOS_DIRECT_DISPATCH=$DISPATCH $LFC $PROJECT_ROOT/$PROGRAM | grep -E "Constraint|Stack|CAVEATS" || true
+    xsim $PROJECT_ROOT/bin/$NAME.xe
+done
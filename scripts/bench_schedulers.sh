@@ -0,0 +1,22 @@
+#!/usr/bin/env bash
+# Build and run a benchmark program with every scheduler backend given on the
+# command line (or all of them) and print the lines it reports at shutdown.
+#
+# Usage: scripts/bench_schedulers.sh src/BenchSchedulers.lf [NP GEDF_NP ...]
+
+# Exit on first error
+set -e
+
+LFC=${LFC:-lfc}
+PROGRAM=$1
+shift
+NAME=$(basename $PROGRAM .lf)
+PROJECT_ROOT=$(cd $(dirname $0)/.. && pwd)
+
+for SCHEDULER in ${@:-NP GEDF_NP DEADLINE DATAFLOW WS STATIC CHANNEL ELASTIC}
+do
+    echo "---- $NAME scheduler=$SCHEDULER"
+    LF_XMOS_SCHEDULER=$SCHEDULER LF_XMOS_DEFINITIONS="$LF_XMOS_DEFINITIONS LF_DEADLINE_STATS" \
+        $LFC $PROJECT_ROOT/$PROGRAM > /dev/null
+    xsim $PROJECT_ROOT/bin/$NAME.xe
+done
@@ -0,0 +1,34 @@
+#!/usr/bin/env bash
+# Build and run a benchmark program on the unthreaded runtime, on the
+# threaded runtime with one worker (SINGLE scheduler, and NP for reference)
+# and with 2 workers, and print the lines it reports at shutdown.
+#
+# Usage: scripts/bench_single_worker.sh [src/BenchTagRate.lf]
+
+# Exit on first error
+set -e
+
+LFC=${LFC:-lfc}
+PROGRAM=${1:-src/BenchTagRate.lf}
+NAME=$(basename $PROGRAM .lf)
+PROJECT_ROOT=$(cd $(dirname $0)/.. && pwd)
+
+# The unthreaded variant needs `threading: false`, so build a copy next to
+# the program in which that replaces the `workers` property.
+UNTHREADED=$(dirname $PROJECT_ROOT/$PROGRAM)/${NAME}Unthreaded.lf
+sed 's/workers: *[0-9]*,/threading: false,/' $PROJECT_ROOT/$PROGRAM > $UNTHREADED
+trap "rm -f $UNTHREADED" EXIT
+echo "---- $NAME unthreaded"
+$LFC $UNTHREADED > /dev/null
+xsim $PROJECT_ROOT/bin/${NAME}Unthreaded.xe
+
+echo "---- $NAME scheduler=SINGLE workers=1"
+LF_XMOS_WORKERS=1 $LFC $PROJECT_ROOT/$PROGRAM > /dev/null
+xsim $PROJECT_ROOT/bin/$NAME.xe
+
+for WORKERS in 1 2
+do
+    echo "---- $NAME scheduler=NP workers=$WORKERS"
+    LF_XMOS_SCHEDULER=NP LF_XMOS_WORKERS=$WORKERS $LFC $PROJECT_ROOT/$PROGRAM > /dev/null
+    xsim $PROJECT_ROOT/bin/$NAME.xe
+done
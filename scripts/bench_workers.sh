@@ -0,0 +1,25 @@
+#!/usr/bin/env bash
+# Run a benchmark program with every scheduler backend given on the command
+# line for 2 to 7 workers (or the counts in BENCH_WORKERS) and print the lines
+# it reports at shutdown.
+#
+# Usage: scripts/bench_workers.sh src/BenchWorkStealing.lf NP WS
+
+# Exit on first error
+set -e
+
+LFC=${LFC:-lfc}
+PROGRAM=$1
+shift
+NAME=$(basename $PROGRAM .lf)
+PROJECT_ROOT=$(cd $(dirname $0)/.. && pwd)
+
+for SCHEDULER in ${@:-NP}
+do
+    for WORKERS in ${BENCH_WORKERS:-2 3 4 5 6 7}
+    do
+        echo "---- $NAME scheduler=$SCHEDULER workers=$WORKERS"
+        LF_XMOS_SCHEDULER=$SCHEDULER LF_XMOS_WORKERS=$WORKERS $LFC $PROJECT_ROOT/$PROGRAM > /dev/null
+        xsim $PROJECT_ROOT/bin/$NAME.xe
+    done
+done
@@ -14,34 +14,122 @@ do
     sed -i 's/platform.h"/lf_platform.h"/g' $f
 done
 
-# FIXME: This script currently only works for threaded runtime
-
 # Copy platform into /core
 cp $PROJECT_ROOT/cmake/xs2a.cmake $LF_SOURCE_GEN_DIRECTORY/xs2a.cmake
 cp $PROJECT_ROOT/platform/lf_xmos_support.c $LF_SOURCE_GEN_DIRECTORY/core/platform/
 cp $PROJECT_ROOT/platform/lf_xmos_support.h $LF_SOURCE_GEN_DIRECTORY/core/platform/
+cp $PROJECT_ROOT/platform/lf_channel.c $LF_SOURCE_GEN_DIRECTORY/core/platform/
+cp $PROJECT_ROOT/platform/lf_channel.h $LF_SOURCE_GEN_DIRECTORY/core/platform/
+cp $PROJECT_ROOT/platform/lf_parallel_for.c $LF_SOURCE_GEN_DIRECTORY/core/platform/
+cp $PROJECT_ROOT/platform/lf_parallel_for.h $LF_SOURCE_GEN_DIRECTORY/core/platform/
+cp $PROJECT_ROOT/platform/lf_background.c $LF_SOURCE_GEN_DIRECTORY/core/platform/
+cp $PROJECT_ROOT/platform/lf_background.h $LF_SOURCE_GEN_DIRECTORY/core/platform/
+cp $PROJECT_ROOT/platform/lf_helpers.c $LF_SOURCE_GEN_DIRECTORY/core/platform/
+cp $PROJECT_ROOT/platform/lf_helpers.h $LF_SOURCE_GEN_DIRECTORY/core/platform/
 cp $PROJECT_ROOT/platform/lf_platform.h $LF_SOURCE_GEN_DIRECTORY/core/
 cp $PROJECT_ROOT/platform/reactor.c $LF_SOURCE_GEN_DIRECTORY/core/
 cp $PROJECT_ROOT/platform/reactor_threaded.c $LF_SOURCE_GEN_DIRECTORY/core/threaded
-#cp $PROJECT_ROOT/platform/reactor_common.c $LF_SOURCE_GEN_DIRECTORY/core/
+cp $PROJECT_ROOT/platform/scheduler_*.c $LF_SOURCE_GEN_DIRECTORY/core/threaded/
+cp $PROJECT_ROOT/platform/semaphore.h $LF_SOURCE_GEN_DIRECTORY/core/utils/
+cp $PROJECT_ROOT/platform/reactor_common.c $LF_SOURCE_GEN_DIRECTORY/core/
 rm $LF_SOURCE_GEN_DIRECTORY/core/platform.h
 
 # Copy platform into /include/core
 # TODO: Why are there two generated core dirs
 cp $PROJECT_ROOT/platform/lf_xmos_support.c $LF_SOURCE_GEN_DIRECTORY/include/core/platform/
 cp $PROJECT_ROOT/platform/lf_xmos_support.h $LF_SOURCE_GEN_DIRECTORY/include/core/platform/
+cp $PROJECT_ROOT/platform/lf_channel.h $LF_SOURCE_GEN_DIRECTORY/include/core/platform/
+cp $PROJECT_ROOT/platform/lf_parallel_for.h $LF_SOURCE_GEN_DIRECTORY/include/core/platform/
+cp $PROJECT_ROOT/platform/lf_background.h $LF_SOURCE_GEN_DIRECTORY/include/core/platform/
+cp $PROJECT_ROOT/platform/lf_helpers.h $LF_SOURCE_GEN_DIRECTORY/include/core/platform/
 cp $PROJECT_ROOT/platform/lf_platform.h $LF_SOURCE_GEN_DIRECTORY/include/core/
 cp $PROJECT_ROOT/platform/reactor.c $LF_SOURCE_GEN_DIRECTORY/include/core/
 cp $PROJECT_ROOT/platform/reactor_threaded.c $LF_SOURCE_GEN_DIRECTORY/include/core/threaded
-#cp $PROJECT_ROOT/platform/reactor_common.c $LF_SOURCE_GEN_DIRECTORY/include/core/
+cp $PROJECT_ROOT/platform/semaphore.h $LF_SOURCE_GEN_DIRECTORY/include/core/utils/
+cp $PROJECT_ROOT/platform/reactor_common.c $LF_SOURCE_GEN_DIRECTORY/include/core/
 rm $LF_SOURCE_GEN_DIRECTORY/include/core/platform.h
 
+# tag.c reads current_tag without synchronization in lf_tag() and
+# lf_time_logical(), which can tear on a 32-bit core. Rename their
+# definitions, so that tag.c itself (e.g. lf_time_logical_elapsed()) and
+# everything else calls the versions in reactor_common.c, which read the tag
+# under a sequence lock. If the pattern stops matching, lf_tag() is defined
+# twice and the build fails.
+for f in $LF_SOURCE_GEN_DIRECTORY/core/tag.c $LF_SOURCE_GEN_DIRECTORY/include/core/tag.c
+do
+    if [ -f $f ]; then
+        sed -i -E -e 's/^(tag_t[[:space:]]+)lf_tag\(/\1_lf_tag_unsynchronized(/' \
+            -e 's/^(instant_t[[:space:]]+)lf_time_logical\(/\1_lf_time_logical_unsynchronized(/' $f
+    fi
+done
+
 # Doing some hacking to get info from old cmake
 echo $PROJECT
 
 # Backup old CMake file
 mv $LF_SOURCE_GEN_DIRECTORY/CMakeLists.txt $LF_SOURCE_GEN_DIRECTORY/CMakeLists_org.txt
 
+# Programs with `threading: false` run on reactor.c and have no workers, no
+# scheduler and no threaded-only helpers. Set LF_XMOS_THREADING to 0 or 1 to
+# override what is found in the generated CMake file.
+if [ -z "$LF_XMOS_THREADING" ]; then
+    if grep -q NUMBER_OF_WORKERS $LF_SOURCE_GEN_DIRECTORY/CMakeLists_org.txt; then
+        LF_XMOS_THREADING=1
+    else
+        LF_XMOS_THREADING=0
+    fi
+fi
+
+# Reaction functions are called through pointers. With
+# LF_XMOS_DIRECT_DISPATCH=1, the generated ones are put in the fptrgroup
+# "lf_reactions", through which the runtime calls them, so that xcc can
+# resolve the calls and report the stack use of every thread.
+if [ "$LF_XMOS_DIRECT_DISPATCH" = "1" ]; then
+    for f in $(find $LF_SOURCE_GEN_DIRECTORY -maxdepth 1 -name '*.[ch]')
+    do
+        sed -i -E 's/^(void _[A-Za-z0-9_]*_function_?[0-9]+\(void\* instance_args\))/__attribute__((fptrgroup("lf_reactions"))) \1/' $f
+    done
+    LF_XMOS_DEFINITIONS="$LF_XMOS_DEFINITIONS LF_DIRECT_DISPATCH"
+fi
+
+# Number of worker threads. LF_XMOS_WORKERS overrides the `workers` target
+# property. At most 7, the main thread occupies the eighth hardware thread.
+LF_WORKERS=$(grep -o 'NUMBER_OF_WORKERS=[0-9]*' $LF_SOURCE_GEN_DIRECTORY/CMakeLists_org.txt | head -n 1 | cut -d = -f 2)
+if [ "$LF_WORKERS" = "0" ]; then
+    # 0 lets the runtime decide, which it cannot do on XMOS.
+    LF_WORKERS=""
+fi
+WORKERS=${LF_XMOS_WORKERS:-${LF_WORKERS:-2}}
+# Scheduler backend. LF_XMOS_SCHEDULER overrides the `scheduler` target
+# property, which defaults to NP. Backends in platform/ are copied over the
+# generated ones. A single worker gets the SINGLE scheduler unless
+# LF_XMOS_SCHEDULER says otherwise.
+LF_SCHEDULER=$(grep -o 'SCHEDULER=[A-Za-z_]*' $LF_SOURCE_GEN_DIRECTORY/CMakeLists_org.txt | head -n 1 | cut -d = -f 2)
+if [ "$WORKERS" = "1" ]; then
+    LF_SCHEDULER=SINGLE
+fi
+SCHEDULER=${LF_XMOS_SCHEDULER:-${LF_SCHEDULER:-NP}}
+if [ "$LF_XMOS_THREADING" = "1" ] && [ ! -f $LF_SOURCE_GEN_DIRECTORY/core/threaded/scheduler_$SCHEDULER.c ]; then
+    echo "Unknown scheduler $SCHEDULER"
+    exit 1
+fi
+if [ "$SCHEDULER" = "SINGLE" ] && [ "$WORKERS" != "1" ]; then
+    echo "The SINGLE scheduler needs exactly one worker"
+    exit 1
+fi
+echo "Building with scheduler $SCHEDULER and $WORKERS workers"
+
+if [ "$LF_XMOS_THREADING" = "1" ]; then
+    THREADED_SRCS="core/platform/lf_parallel_for.c
+   core/platform/lf_background.c
+   core/threaded/scheduler_$SCHEDULER.c"
+    THREADED_DEFINITIONS="NUMBER_OF_WORKERS=$WORKERS
+   LF_SCHED_$SCHEDULER"
+else
+    THREADED_SRCS=""
+    THREADED_DEFINITIONS=""
+fi
+
 # Create CMake file
 printf '
 cmake_minimum_required(VERSION 3.24)
@@ -55,13 +143,14 @@ file(GLOB LF_GEN_SRCS *.c )
 set(APP_SRCS
    ${LF_GEN_SRCS}
    core/platform/lf_xmos_support.c
+   core/platform/lf_channel.c
+   core/platform/lf_helpers.c
    lib/schedule.c
    lib/tag.c
    lib/time.c
    lib/util.c
    core/mixed_radix.c
-   core/threaded/scheduler_NP.c
-   core/utils/semaphore.c
+   %s
 )
 
 set(APP_INCLUDES
@@ -82,7 +171,8 @@ set(APP_COMPILE_DEFINITIONS
    LIBXCORE_XASSERT_IS_ASSERT
    __xmos__
    LF_TARGET_EMBEDDED
-   NUMBER_OF_WORKERS=2
+   %s
+   %s
 )
 
 ## Set your link options
@@ -102,7 +192,7 @@ install(
     TARGETS my_app
     RUNTIME DESTINATION %s
 )
-' $APP_NAME $LF_BIN_DIRECTORY >  $LF_SOURCE_GEN_DIRECTORY/CMakeLists.txt
+' $APP_NAME "$THREADED_SRCS" "$THREADED_DEFINITIONS" "$LF_XMOS_DEFINITIONS" $LF_BIN_DIRECTORY >  $LF_SOURCE_GEN_DIRECTORY/CMakeLists.txt
 
 cd $LF_SOURCE_GEN_DIRECTORY
 
@@ -0,0 +1,105 @@
+#include <stdio.h>
+
+#include "platform/lf_platform.h"
+
+#ifndef LF_HOST_STAND_IN
+#include <xcore/assert.h>
+#endif
+
+#define ROUNDS 10000
+
+#ifdef LF_HOST_STAND_IN
+#define MAX_THREADS 8
+#else
+// Thread table of the XMOS platform. Build with NUMBER_OF_WORKERS=7 to
+// measure up to 8 threads.
+#define MAX_THREADS NUMBER_OF_THREADS
+#endif
+
+extern lf_mutex_t mutex;
+
+// Barrier from the mutex and a condition variable, as used by the schedulers
+// before lf_barrier_t.
+static lf_cond_t released;
+static int arrived = 0;
+static unsigned generation = 0;
+
+static int parties;
+static lf_barrier_t barrier;
+// Incremented by the last party of every phase, checked by all parties.
+static volatile int phase = 0;
+
+void cond_barrier_wait() {
+    lf_mutex_lock(&mutex);
+    if (++arrived == parties) {
+        arrived = 0;
+        generation++;
+        lf_cond_broadcast(&released);
+    } else {
+        unsigned current = generation;
+        while (current == generation) {
+            lf_cond_wait(&released, &mutex);
+        }
+    }
+    lf_mutex_unlock(&mutex);
+}
+
+void barrier_wait() {
+    int sense;
+    if (lf_barrier_arrive(&barrier, &sense)) {
+        phase++;
+        lf_barrier_release(&barrier);
+    } else {
+        while (!lf_barrier_wait(&barrier, sense));
+    }
+}
+
+void* cond_party(void* args) {
+    for (int i = 0; i < ROUNDS; i++) {
+        cond_barrier_wait();
+    }
+    return NULL;
+}
+
+void* barrier_party(void* args) {
+    for (int i = 0; i < ROUNDS; i++) {
+        barrier_wait();
+        xassert(phase == 2 * i + 1);
+        // Nobody can get past the next phase before we arrive.
+        barrier_wait();
+    }
+    return NULL;
+}
+
+interval_t run(int threads, void* (*party)(void*)) {
+    lf_thread_t others[MAX_THREADS];
+    parties = threads;
+    instant_t start, end;
+    lf_clock_gettime(&start);
+    for (int i = 0; i < threads - 1; i++) {
+        xassert(lf_thread_create(&others[i], party, NULL) == 0);
+    }
+    party(NULL);
+    for (int i = 0; i < threads - 1; i++) {
+        lf_thread_join(others[i], NULL);
+    }
+    lf_clock_gettime(&end);
+    return end - start;
+}
+
+int main() {
+    lf_initialize_clock();
+    lf_mutex_init(&mutex);
+    lf_cond_init(&released);
+    for (int threads = 2; threads <= MAX_THREADS; threads++) {
+        interval_t cond = run(threads, cond_party) / ROUNDS;
+        xassert(lf_barrier_init(&barrier, threads) == 0);
+        phase = 0;
+        // Two phases per round.
+        interval_t native = run(threads, barrier_party) / (2 * ROUNDS);
+        xassert(phase == 2 * ROUNDS);
+        lf_barrier_free(&barrier);
+        printf("barrier: %d threads, %lld ns per phase (mutex and condition variable: %lld ns)\n",
+                threads, (long long) native, (long long) cond);
+    }
+}
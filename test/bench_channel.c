@@ -0,0 +1,101 @@
+#include <stdio.h>
+
+#include "platform/lf_platform.h"
+#include "platform/lf_channel.h"
+
+#ifndef LF_HOST_STAND_IN
+#include <xcore/assert.h>
+#endif
+
+#define ROUND_TRIPS 1000
+#define SENDERS 3
+#define MESSAGES_PER_SENDER 1000
+
+typedef struct {
+    lf_channel_t inbox;
+    lf_channel_sender_t to_peer;
+} endpoint_t;
+
+static endpoint_t ping;
+static endpoint_t pong;
+
+void* echo(void* args) {
+    for (int i = 0; i < ROUND_TRIPS; i++) {
+        uintptr_t word = lf_channel_receive(&pong.inbox);
+        lf_channel_send(&pong.to_peer, word);
+    }
+    return NULL;
+}
+
+void bench_round_trip() {
+    lf_channel_init(&ping.inbox);
+    lf_channel_init(&pong.inbox);
+    lf_channel_connect(&pong.inbox, &ping.to_peer);
+    lf_channel_connect(&ping.inbox, &pong.to_peer);
+
+    lf_thread_t tid;
+    lf_thread_create(&tid, &echo, NULL);
+
+    instant_t start, end;
+    lf_clock_gettime(&start);
+    for (int i = 0; i < ROUND_TRIPS; i++) {
+        lf_channel_send(&ping.to_peer, i);
+        xassert(lf_channel_receive(&ping.inbox) == (uintptr_t) i);
+    }
+    lf_clock_gettime(&end);
+    lf_thread_join(tid, NULL);
+    printf("round trip: %lld ns\n", (long long) (end - start) / ROUND_TRIPS);
+
+    lf_channel_disconnect(&ping.to_peer);
+    lf_channel_disconnect(&pong.to_peer);
+    lf_channel_free(&ping.inbox);
+    lf_channel_free(&pong.inbox);
+}
+
+static lf_channel_t fan_in;
+static lf_channel_sender_t senders[SENDERS];
+
+void* send_sequence(void* args) {
+    uintptr_t id = (uintptr_t) args;
+    for (uintptr_t i = 0; i < MESSAGES_PER_SENDER; i++) {
+        lf_channel_send(&senders[id], (id << 16) | i);
+    }
+    return NULL;
+}
+
+void bench_fan_in() {
+    lf_channel_init(&fan_in);
+    for (int i = 0; i < SENDERS; i++) {
+        lf_channel_connect(&fan_in, &senders[i]);
+    }
+
+    lf_thread_t tid[SENDERS];
+    instant_t start, end;
+    lf_clock_gettime(&start);
+    for (uintptr_t i = 0; i < SENDERS; i++) {
+        lf_thread_create(&tid[i], &send_sequence, (void*) i);
+    }
+    // Messages of each sender must arrive in order.
+    uintptr_t next[SENDERS] = {0};
+    for (int i = 0; i < SENDERS * MESSAGES_PER_SENDER; i++) {
+        uintptr_t word = lf_channel_receive(&fan_in);
+        uintptr_t id = word >> 16;
+        xassert(id < SENDERS);
+        xassert((word & 0xFFFF) == next[id]);
+        next[id]++;
+    }
+    lf_clock_gettime(&end);
+    for (int i = 0; i < SENDERS; i++) {
+        lf_thread_join(tid[i], NULL);
+        lf_channel_disconnect(&senders[i]);
+    }
+    lf_channel_free(&fan_in);
+    printf("fan-in from %d senders: %lld ns per message\n", SENDERS,
+            (long long) (end - start) / (SENDERS * MESSAGES_PER_SENDER));
+}
+
+int main() {
+    lf_initialize_clock();
+    bench_round_trip();
+    bench_fan_in();
+}
@@ -0,0 +1,115 @@
+#include <stdio.h>
+
+#include "platform/lf_platform.h"
+#include "platform/lf_parallel_for.h"
+
+#ifndef LF_HOST_STAND_IN
+#include <xcore/assert.h>
+#endif
+
+// FIR filter bank: every channel filters a block of samples with TAPS taps.
+#define CHANNELS 32
+#define SAMPLES 256
+#define TAPS 32
+#define BLOCKS 20
+
+#ifdef LF_HOST_STAND_IN
+#define MAX_WORKERS 8
+#else
+// Thread table of the XMOS platform: the main thread and the helpers.
+#define MAX_WORKERS NUMBER_OF_WORKERS
+#endif
+
+extern lf_mutex_t mutex;
+
+static int32_t input[CHANNELS][SAMPLES + TAPS];
+static int32_t coefficients[CHANNELS][TAPS];
+static int64_t output[CHANNELS][SAMPLES];
+
+// Idle helpers, standing in for workers waiting in a scheduler.
+static lf_cond_t idle;
+static bool stop = false;
+
+void wake_idle() {
+    lf_cond_broadcast(&idle);
+}
+
+void* helper(void* args) {
+    lf_mutex_lock(&mutex);
+    while (!stop) {
+        if (!lf_parallel_for_help()) {
+            lf_cond_wait(&idle, &mutex);
+        }
+    }
+    lf_mutex_unlock(&mutex);
+    return NULL;
+}
+
+void fir(size_t begin, size_t end, void* arg) {
+    for (size_t c = begin; c < end; c++) {
+        for (int n = 0; n < SAMPLES; n++) {
+            int64_t acc = 0;
+            for (int k = 0; k < TAPS; k++) {
+                acc += (int64_t) input[c][n + k] * coefficients[c][k];
+            }
+            output[c][n] = acc;
+        }
+    }
+}
+
+int64_t checksum() {
+    int64_t sum = 0;
+    for (int c = 0; c < CHANNELS; c++) {
+        for (int n = 0; n < SAMPLES; n++) {
+            sum = sum * 31 + output[c][n];
+        }
+    }
+    return sum;
+}
+
+int main() {
+    lf_initialize_clock();
+    lf_mutex_init(&mutex);
+    lf_cond_init(&idle);
+    lf_parallel_for_init(wake_idle);
+    for (int c = 0; c < CHANNELS; c++) {
+        for (int n = 0; n < SAMPLES + TAPS; n++) {
+            input[c][n] = (c * 7919 + n * 104729) % 65536 - 32768;
+        }
+        for (int k = 0; k < TAPS; k++) {
+            coefficients[c][k] = (c + 1) * (k % 5 - 2);
+        }
+    }
+
+    fir(0, CHANNELS, NULL);
+    int64_t expected = checksum();
+
+    lf_thread_t helpers[MAX_WORKERS];
+    interval_t serial = 0;
+    for (int workers = 1; workers <= MAX_WORKERS; workers++) {
+        if (workers > 1) {
+            lf_thread_create(&helpers[workers - 2], &helper, NULL);
+        }
+        instant_t start, end;
+        lf_clock_gettime(&start);
+        for (int b = 0; b < BLOCKS; b++) {
+            lf_parallel_for(0, CHANNELS, 1, fir, NULL);
+        }
+        lf_clock_gettime(&end);
+        xassert(checksum() == expected);
+        interval_t elapsed = (end - start) / BLOCKS;
+        if (workers == 1) {
+            serial = elapsed;
+        }
+        printf("fir: %d workers, %lld ns per block, speedup %.2f\n", workers, (long long) elapsed,
+                (double) serial / elapsed);
+    }
+
+    lf_mutex_lock(&mutex);
+    stop = true;
+    lf_cond_broadcast(&idle);
+    lf_mutex_unlock(&mutex);
+    for (int i = 0; i < MAX_WORKERS - 1; i++) {
+        lf_thread_join(helpers[i], NULL);
+    }
+}
@@ -6,7 +6,7 @@ CWD=`pwd`
 PROGRAM=$1
 ROOT=$CWD/..
 
-xcc -target=XCORE-200-EXPLORER -g $CWD/$1.c $ROOT/platform/lf_xmos_support.c -I$ROOT -I$ROOT/platform -D__xmos__ -DLF_TARGET_EMBEDDED -DNUMBER_OF_WORKERS=4
+xcc -target=XCORE-200-EXPLORER -g $CWD/$1.c $ROOT/platform/lf_xmos_support.c $ROOT/platform/lf_channel.c $ROOT/platform/lf_actor.c $ROOT/platform/lf_parallel_for.c -I$ROOT -I$ROOT/platform -D__xmos__ -DLF_TARGET_EMBEDDED -DNUMBER_OF_WORKERS=4
 
 
 xsim a.xe
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include <stdio.h>
+
+#include "platform/lf_platform.h"
+#include "platform/lf_actor.h"
+
+#ifndef LF_HOST_STAND_IN
+#include <xcore/assert.h>
+#endif
+
+#define RUNS 5
+#define PERIOD 1000000LL
+#define TIMEOUT 200000000LL
+
+// Source -> Scale -> Sink, and Source -> Sink directly on a second input.
+// Source also sends at a later microstep on some tags.
+
+typedef struct {
+    int count;
+} source_t;
+
+typedef struct {
+    uint32_t hash;
+    int tags;
+} sink_t;
+
+void source_react(lf_actor_t* actor) {
+    source_t* state = (source_t*) actor->state;
+    if (lf_actor_timer_fired(actor)) {
+        state->count++;
+        lf_actor_set(actor, 0, state->count);
+        if (state->count % 3 == 0) {
+            lf_actor_set(actor, 1, state->count);
+        }
+        if (state->count % 5 == 0) {
+            lf_actor_schedule(actor, 0);
+        }
+    }
+    if (lf_actor_event_fired(actor)) {
+        lf_actor_set(actor, 0, 1000 + state->count);
+    }
+}
+
+void scale_react(lf_actor_t* actor) {
+    if (lf_actor_is_present(actor, 0)) {
+        lf_actor_set(actor, 0, 2 * lf_actor_get(actor, 0));
+    }
+}
+
+void sink_react(lf_actor_t* actor) {
+    sink_t* state = (sink_t*) actor->state;
+    uint32_t h = state->hash;
+    h = h * 31 + (uint32_t) (lf_actor_elapsed_time(actor) / PERIOD);
+    h = h * 31 + lf_actor_tag(actor).microstep;
+    for (int i = 0; i < 2; i++) {
+        h = h * 31 + lf_actor_is_present(actor, i);
+        if (lf_actor_is_present(actor, i)) {
+            h = h * 31 + (uint32_t) lf_actor_get(actor, i);
+        }
+    }
+    state->hash = h;
+    state->tags++;
+}
+
+void run(bool fast, sink_t* result, interval_t* elapsed) {
+    source_t source_state = {0};
+    sink_t sink_state = {0, 0};
+    lf_actor_t source, scale, sink;
+    lf_actor_init(&source, "source", source_react, &source_state, 0);
+    lf_actor_init(&scale, "scale", scale_react, NULL, 1);
+    lf_actor_init(&sink, "sink", sink_react, &sink_state, 2);
+    lf_actor_timer(&source, 0, PERIOD);
+    lf_actor_connect(&source, 0, &scale, 0);
+    lf_actor_connect(&scale, 0, &sink, 0);
+    lf_actor_connect(&source, 1, &sink, 1);
+
+    lf_actor_t* actors[] = {&source, &scale, &sink};
+    instant_t start, end;
+    lf_clock_gettime(&start);
+    xassert(lf_actor_run(actors, 3, TIMEOUT, fast) == 0);
+    lf_clock_gettime(&end);
+
+    lf_actor_free(&source);
+    lf_actor_free(&scale);
+    lf_actor_free(&sink);
+    *result = sink_state;
+    *elapsed = end - start;
+}
+
+void test_determinism() {
+    sink_t first;
+    interval_t elapsed;
+    run(true, &first, &elapsed);
+    // 201 timer tags, and 40 extra microsteps.
+    xassert(first.tags == 241);
+    for (int i = 1; i < RUNS; i++) {
+        sink_t other;
+        run(true, &other, &elapsed);
+        xassert(other.tags == first.tags);
+        xassert(other.hash == first.hash);
+    }
+    printf("determinism: %d runs of %d tags, hash %08x\n", RUNS, first.tags, (unsigned) first.hash);
+}
+
+void bench_throughput() {
+    sink_t result;
+    interval_t elapsed;
+    run(true, &result, &elapsed);
+    printf("throughput: %lld ns per tag through 3 actors\n", (long long) elapsed / result.tags);
+}
+
+// Three stages that each spin for WORK ns per tag. With pipelining, a tag
+// takes about WORK once the pipeline is full, instead of 3 * WORK.
+#define WORK 20000LL
+#define STAGES 3
+
+void stage_react(lf_actor_t* actor) {
+    instant_t start, now;
+    lf_clock_gettime(&start);
+    do {
+        lf_clock_gettime(&now);
+    } while (now - start < WORK);
+    lf_actor_set(actor, 0, lf_actor_is_present(actor, 0) ? lf_actor_get(actor, 0) + 1 : 0);
+}
+
+void bench_pipeline() {
+    lf_actor_t stages[STAGES];
+    lf_actor_t* actors[STAGES];
+    for (int i = 0; i < STAGES; i++) {
+        xassert(lf_actor_init(&stages[i], "stage", stage_react, NULL, i > 0 ? 1 : 0) == 0);
+        actors[i] = &stages[i];
+    }
+    lf_actor_timer(&stages[0], 0, PERIOD);
+    for (int i = 1; i < STAGES; i++) {
+        xassert(lf_actor_connect(&stages[i - 1], 0, &stages[i], 0) == 0);
+    }
+    instant_t start, end;
+    lf_clock_gettime(&start);
+    xassert(lf_actor_run(actors, STAGES, TIMEOUT, true) == 0);
+    lf_clock_gettime(&end);
+    xassert(stages[STAGES - 1].tags_processed == stages[0].tags_processed);
+    printf("pipeline: %lld ns per tag through %d stages of %lld ns, depth %d\n",
+            (long long) (end - start) / (long long) stages[0].tags_processed, STAGES, WORK,
+            LF_ACTOR_PIPELINE_DEPTH);
+    for (int i = 0; i < STAGES; i++) {
+        lf_actor_free(&stages[i]);
+    }
+}
+
+void test_real_time() {
+    sink_t fast, slow;
+    interval_t elapsed;
+    run(true, &fast, &elapsed);
+    run(false, &slow, &elapsed);
+    xassert(slow.hash == fast.hash);
+    // Physical time must have caught up with the last tag.
+    xassert(elapsed >= TIMEOUT);
+    printf("real time: same result, %lld ns\n", (long long) elapsed);
+}
+
+int main() {
+    lf_initialize_clock();
+    test_determinism();
+    bench_throughput();
+    bench_pipeline();
+    test_real_time();
+}
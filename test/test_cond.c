@@ -47,7 +47,7 @@ void test_timed_wait() {
     lf_thread_t t1;
     lf_thread_create(&t1, &synchronize_wait_timeout, &args);
     lf_thread_join(t1, NULL);
-    lock_free(mutex.lock);
+    lf_xmos_mutex_free(&mutex);
 }
 
 void test_timed_wait_no_timeout() {
@@ -62,7 +62,7 @@ void test_timed_wait_no_timeout() {
     lf_sleep(1000);
     lf_cond_broadcast(&cond);
     lf_thread_join(t1, NULL);
-    lock_free(mutex.lock);
+    lf_xmos_mutex_free(&mutex);
 }
 
 void wait(void * args) {
@@ -106,7 +106,7 @@ lf_thread_t t1,t2;
     lf_thread_create(&t2, &signal, &args);
     lf_thread_join(t1, NULL);
     lf_thread_join(t2, NULL);
-    lock_free(mutex.lock);
+    lf_xmos_mutex_free(&mutex);
 
 }
 
@@ -129,7 +129,7 @@ lf_thread_t t1,t2,t3,t4;
     lf_thread_join(t2, NULL);
     lf_thread_join(t3, NULL);
     lf_thread_join(t4, NULL);
-    lock_free(mutex.lock);
+    lf_xmos_mutex_free(&mutex);
 
 }
 
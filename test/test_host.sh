@@ -0,0 +1,14 @@
+#!/bin/bash
+
+# Build and run a test against the POSIX stand-in of the platform.
+
+set -e
+
+CWD=`pwd`
+PROGRAM=$1
+ROOT=$CWD/..
+
+cc -g -O2 $CWD/$1.c $ROOT/platform/lf_host_support.c $ROOT/platform/lf_channel.c $ROOT/platform/lf_actor.c $ROOT/platform/lf_parallel_for.c -I$ROOT -I$ROOT/platform -DLF_HOST_STAND_IN -DLF_TARGET_EMBEDDED -DNUMBER_OF_WORKERS=4 -lpthread -o a.out
+
+
+./a.out
@@ -33,6 +33,7 @@ void test_mutex() {
     for (int i = 0; i<4; i++) {
         lf_thread_join(tid[i], 0);
     }
+    lf_xmos_mutex_free(&mutex);
 }
 
 void test_recursive_mutex() {
@@ -42,10 +43,60 @@ void test_recursive_mutex() {
     lf_mutex_lock(&m);
     lf_mutex_unlock(&m);
     lf_mutex_unlock(&m);
+    lf_xmos_mutex_free(&m);
+}
+
+#define MUTEXES 6
+#define INCREMENTS 1000
+
+typedef struct {
+    lf_mutex_t* mutexes;
+    int* counters;
+} many_args_t;
+
+void increment_all(void * args) {
+    many_args_t *a = (many_args_t *) args;
+    for (int n = 0; n<INCREMENTS; n++) {
+        for (int i = 0; i<MUTEXES; i++) {
+            lf_mutex_lock(&a->mutexes[i]);
+            a->counters[i]++;
+            lf_mutex_unlock(&a->mutexes[i]);
+        }
+    }
+}
+
+// More mutexes than there are hardware locks on a tile.
+void test_many_mutexes() {
+    lf_mutex_t mutexes[MUTEXES];
+    int counters[MUTEXES] = {0};
+    for (int i = 0; i<MUTEXES; i++) {
+        xassert(lf_mutex_init(&mutexes[i]) == 0);
+    }
+    int hardware, software;
+    lf_xmos_mutex_usage(&hardware, &software);
+    printf("mutexes: %d with a hardware lock, %d with a bakery lock\n", hardware, software);
+    xassert(hardware + software == MUTEXES);
+
+    many_args_t args = {mutexes, counters};
+    lf_thread_t tid[4];
+    for (int i = 0; i<4; i++) {
+        lf_thread_create(&tid[i], &increment_all, &args);
+    }
+    for (int i = 0; i<4; i++) {
+        lf_thread_join(tid[i], 0);
+    }
+    for (int i = 0; i<MUTEXES; i++) {
+        xassert(counters[i] == 4 * INCREMENTS);
+        lf_xmos_mutex_free(&mutexes[i]);
+    }
+    lf_xmos_mutex_usage(&hardware, &software);
+    xassert(hardware + software == 0);
+    printf("many mutexes: ok\n");
 }
 
 int main() {
     lf_initialize_clock();
     test_mutex();
     test_recursive_mutex();
+    test_many_mutexes();
 }
@@ -0,0 +1,124 @@
+#include <stdio.h>
+
+#include "platform/lf_platform.h"
+
+#ifndef LF_HOST_STAND_IN
+#include <xcore/assert.h>
+#endif
+
+#define ROUNDS 10000
+#define WAITERS 3
+
+extern lf_mutex_t mutex;
+
+static lf_semaphore_t* ping;
+static lf_semaphore_t* pong;
+static volatile int acquired = 0;
+
+void* waiter(void* args) {
+    lf_semaphore_acquire(ping);
+    lf_atomic_fetch_add(&acquired, 1);
+    lf_semaphore_acquire(pong);
+    return NULL;
+}
+
+// Permits released at once are handed to as many waiting threads.
+void test_release_many() {
+    ping = lf_semaphore_new(0);
+    pong = lf_semaphore_new(WAITERS);
+    xassert(ping && pong);
+    lf_thread_t threads[WAITERS];
+    for (int i = 0; i < WAITERS; i++) {
+        xassert(lf_thread_create(&threads[i], waiter, NULL) == 0);
+    }
+    lf_semaphore_release(ping, WAITERS);
+    // Every waiter takes one permit of 'pong', so it reaches zero.
+    lf_semaphore_wait(pong);
+    xassert(acquired == WAITERS);
+    for (int i = 0; i < WAITERS; i++) {
+        lf_thread_join(threads[i], NULL);
+    }
+    lf_semaphore_destroy(ping);
+    lf_semaphore_destroy(pong);
+    printf("release many: ok\n");
+}
+
+void* ponger(void* args) {
+    for (int i = 0; i < ROUNDS; i++) {
+        lf_semaphore_acquire(ping);
+        lf_semaphore_release(pong, 1);
+    }
+    return NULL;
+}
+
+// Semaphore from the mutex and a condition variable, like core/utils/semaphore.c.
+typedef struct {
+    int count;
+    lf_cond_t changed;
+} cond_semaphore_t;
+
+static cond_semaphore_t cond_ping;
+static cond_semaphore_t cond_pong;
+
+void cond_release(cond_semaphore_t* semaphore) {
+    lf_mutex_lock(&mutex);
+    semaphore->count++;
+    lf_cond_broadcast(&semaphore->changed);
+    lf_mutex_unlock(&mutex);
+}
+
+void cond_acquire(cond_semaphore_t* semaphore) {
+    lf_mutex_lock(&mutex);
+    while (semaphore->count == 0) {
+        lf_cond_wait(&semaphore->changed, &mutex);
+    }
+    semaphore->count--;
+    lf_mutex_unlock(&mutex);
+}
+
+void* cond_ponger(void* args) {
+    for (int i = 0; i < ROUNDS; i++) {
+        cond_acquire(&cond_ping);
+        cond_release(&cond_pong);
+    }
+    return NULL;
+}
+
+void bench_ping_pong() {
+    ping = lf_semaphore_new(0);
+    pong = lf_semaphore_new(0);
+    lf_thread_t thread;
+    instant_t start, end;
+    lf_clock_gettime(&start);
+    xassert(lf_thread_create(&thread, ponger, NULL) == 0);
+    for (int i = 0; i < ROUNDS; i++) {
+        lf_semaphore_release(ping, 1);
+        lf_semaphore_acquire(pong);
+    }
+    lf_thread_join(thread, NULL);
+    lf_clock_gettime(&end);
+    interval_t native = (end - start) / ROUNDS;
+    lf_semaphore_destroy(ping);
+    lf_semaphore_destroy(pong);
+
+    lf_cond_init(&cond_ping.changed);
+    lf_cond_init(&cond_pong.changed);
+    lf_clock_gettime(&start);
+    xassert(lf_thread_create(&thread, cond_ponger, NULL) == 0);
+    for (int i = 0; i < ROUNDS; i++) {
+        cond_release(&cond_ping);
+        cond_acquire(&cond_pong);
+    }
+    lf_thread_join(thread, NULL);
+    lf_clock_gettime(&end);
+    interval_t cond = (end - start) / ROUNDS;
+    printf("ping pong: %lld ns per round trip (mutex and condition variable: %lld ns)\n",
+            (long long) native, (long long) cond);
+}
+
+int main() {
+    lf_initialize_clock();
+    lf_mutex_init(&mutex);
+    test_release_many();
+    bench_ping_pong();
+}
@@ -0,0 +1,50 @@
+#include <stdio.h>
+
+#include "platform/lf_platform.h"
+
+#ifndef LF_HOST_STAND_IN
+#include <xcore/assert.h>
+#endif
+
+#define THREADS 3
+
+static lf_mutex_t recursive;
+static int values[THREADS];
+
+void* party(void* args) {
+    int number = (int) (intptr_t) args;
+    lf_thread_context_t* context = lf_thread_context();
+    // Every thread starts from a clean context.
+    xassert(context->worker_number == -1);
+    xassert(context->locks_held == 0);
+    xassert(context->caches[0] == NULL);
+    context->worker_number = number;
+    context->caches[0] = &values[number];
+
+    lf_mutex_lock(&recursive);
+    lf_mutex_lock(&recursive);
+    xassert(lf_thread_context()->locks_held == 2);
+    lf_mutex_unlock(&recursive);
+    lf_mutex_unlock(&recursive);
+    xassert(lf_thread_context()->locks_held == 0);
+
+    // Nobody else has touched this thread's context.
+    xassert(lf_thread_context() == context);
+    xassert(context->worker_number == number);
+    xassert(context->caches[0] == &values[number]);
+    return NULL;
+}
+
+int main() {
+    lf_initialize_clock();
+    lf_mutex_init(&recursive);
+    lf_thread_t threads[THREADS];
+    for (int i = 0; i < THREADS; i++) {
+        xassert(lf_thread_create(&threads[i], party, (void*) (intptr_t) i) == 0);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        lf_thread_join(threads[i], NULL);
+    }
+    xassert(lf_thread_context()->worker_number == -1);
+    printf("thread context: ok\n");
+}